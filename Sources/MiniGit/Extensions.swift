@@ -32,6 +32,15 @@ extension DiffDelta: Identifiable {
             return theNewFile.path!
         }
     }
+
+    /// The path, as "old -> new" for a rename or copy
+    public var displayPath: String {
+        if (status == "R" || status == "C"), let oldpath = theOldFile.path, let newpath = theNewFile.path {
+            return "\(oldpath) -> \(newpath)"
+        }
+
+        return path
+    }
 }
 
 extension DiffLine: Identifiable {
@@ -41,4 +50,18 @@ extension DiffLine: Identifiable {
 }
 
 extension DiffHunk: Identifiable {
+    /// The changed byte ranges (in the UTF-8 view of the text) of each line, see `intraLineChanges`
+    public var intraLineRanges: [[Range<Int>]] {
+        return intraLineChanges().map { data in
+            data.withUnsafeBytes { buffer in
+                let values = buffer.bindMemory(to: UInt32.self)
+                return stride(from: 0, to: values.count, by: 2).map { i in
+                    Int(values[i])..<Int(values[i] + values[i + 1])
+                }
+            }
+        }
+    }
+}
+
+extension BlameHunk: Identifiable {
 }
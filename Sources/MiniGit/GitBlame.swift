@@ -0,0 +1,49 @@
+//
+//  GitBlame.swift
+//  Implementation of BlameProtocol to host the result of the `git blame` command
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+import SwiftUI
+import XGit
+
+@available(iOS 14, macOS 11.0, *)
+public class GitBlame: BlameProtocol, ObservableObject {
+
+    @Published public var lineCount = 0
+
+    // Hunks attributed so far, sorted by line
+    @Published public var hunks = [BlameHunk]()
+
+    @Published public var inProgress = false
+
+    public init() {
+    }
+
+    // Blame runs on the thread that uses the repository. The published properties are
+    // updated on the main thread, like the other progress objects do, so that they are
+    // never changed in the middle of a SwiftUI view update.
+
+    public func setLineCount(_ lineCount: Int) {
+        DispatchQueue.main.async {
+            self.lineCount = lineCount
+            self.hunks.removeAll()
+            self.inProgress = true
+        }
+    }
+
+    public func add(_ hunk: BlameHunk) {
+        DispatchQueue.main.async {
+            let index = self.hunks.firstIndex(where: { $0.finalStartLine > hunk.finalStartLine }) ?? self.hunks.endIndex
+            self.hunks.insert(hunk, at: index)
+        }
+    }
+
+    public func onComplete() {
+        DispatchQueue.main.async {
+            self.inProgress = false
+        }
+    }
+
+}
@@ -0,0 +1,23 @@
+//
+//  GitDiffStat.swift
+//  Implementation of DiffStatReceiverProtocol to host the result of the `git diff --stat` command
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+import SwiftUI
+import XGit
+
+@available(iOS 14, macOS 11.0, *)
+public class GitDiffStat: DiffStatReceiverProtocol, ObservableObject {
+
+    @Published public var stat: DiffStat = DiffStat()
+
+    public init() {
+    }
+
+    public func setStat(_ stat: DiffStat) {
+        self.stat = stat
+    }
+
+}
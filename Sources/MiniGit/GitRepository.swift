@@ -28,6 +28,9 @@ public class GitRepository: Repository, Identifiable, ObservableObject {
     public var mergeProgress = MergeCheckoutProgress()
     public var errorReceiver = SimpleErrorReceiver()
 
+    @Published public var lastMaintenance: MaintenanceResult?
+    var maintenanceTimer: DispatchSourceTimer?
+
     public init(_ location: URL, _ credentialsManager: CredentialsManager) {
         self.location = location
         self.credentialsManager = credentialsManager
@@ -53,6 +56,18 @@ public class GitRepository: Repository, Identifiable, ObservableObject {
     public func updateCommitGraph() {
         log(commitGraph)
         commitGraph.needLoading = false
+        updateChangedPathsIndexInBackground()
+    }
+
+    public func updateCommitGraph(_ paths: [String]) {
+        log(commitGraph, paths)
+        commitGraph.needLoading = false
+    }
+
+    func updateChangedPathsIndexInBackground() {
+        DispatchQueue.global(qos: .background).async {
+            self.updateChangedPathsIndex()
+        }
     }
 
     func onRepositoryExistenceChanged() {
@@ -108,6 +123,20 @@ public class GitRepository: Repository, Identifiable, ObservableObject {
         onCommitGraphChanged()
     }
 
+    public override func importCommits(_ commits: [ImportCommit], _ errorReceiver: ErrorReceiverProtocol?) -> [OID]? {
+        let result = super.importCommits(commits, errorReceiver)
+
+        // The status only changes when the checked out branch moved
+        let headBranch = "refs/heads/" + status.currentBranch
+        if result != nil && commits.contains(where: { $0.refName == "HEAD" || $0.refName == headBranch }) {
+            onStatusChanged()
+        }
+
+        onCommitGraphChanged()
+
+        return result
+    }
+
     public override func createBranch(_ branchName: String, _ commit: Commit) {
         super.createBranch(branchName, commit)
         onReferencesListChanged()
@@ -169,6 +198,14 @@ public class GitRepository: Repository, Identifiable, ObservableObject {
         }
     }
 
+    /// Clone the local repository at `url`, borrowing objects from `reference` (the source itself for a shared clone)
+    public func clone(_ url: String, reference: String) {
+        remoteProgress.clearState("Clone from \(url) with reference \(reference)", credentialsManager.getCredentialForUrl(url))
+        DispatchQueue.global().async {
+            self.clone(url, reference, self.remoteProgress, nil /*self.mergeProgress*/, self.remoteProgress.errorReceiver)
+        }
+    }
+
     public func reset(_ commit: Commit) {
         mergeProgress.clearState("Reset", forMerging: false)
         reset(commit, self.mergeProgress, self.mergeProgress.errorReceiver)
@@ -198,4 +235,49 @@ public class GitRepository: Repository, Identifiable, ObservableObject {
         }
     }
 
+    /// Fetch the given remotes (all remotes if nil) with at most `parallelism` downloads at a time
+    public func fetchAll(_ remotes: [Remote]? = nil, _ parallelism: Int = 4) {
+        // The credential of each remote is looked up by its URL
+        remoteProgress.clearState("Fetch from \(remotes?.map { $0.name }.joined(separator: ", ") ?? "all remotes")", nil)
+        DispatchQueue.global().async {
+            self.fetchAll(remotes, UInt(max(parallelism, 0)), self.remoteProgress, self.remoteProgress.errorReceiver)
+        }
+    }
+
+    public func maintain() {
+        errorReceiver.clearError()
+        DispatchQueue.global(qos: .utility).async {
+            let result = self.maintain(self.errorReceiver)
+            DispatchQueue.main.async {
+                self.lastMaintenance = result
+            }
+        }
+    }
+
+    /// Check every `interval` seconds in the background and maintain the repository when due
+    public func scheduleMaintenance(_ interval: TimeInterval) {
+        maintenanceTimer?.cancel()
+
+        let timer = DispatchSource.makeTimerSource(queue: DispatchQueue.global(qos: .background))
+        timer.schedule(deadline: .now() + interval, repeating: interval)
+        timer.setEventHandler { [weak self] in
+            guard let self = self, self.maintenanceIsDue() else {
+                return
+            }
+
+            let result = self.maintain(nil)
+            DispatchQueue.main.async {
+                self.lastMaintenance = result
+            }
+        }
+        timer.resume()
+
+        maintenanceTimer = timer
+    }
+
+    public func cancelScheduledMaintenance() {
+        maintenanceTimer?.cancel()
+        maintenanceTimer = nil
+    }
+
 }
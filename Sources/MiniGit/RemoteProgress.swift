@@ -135,6 +135,10 @@ public class RemoteProgress: RemoteProgressProtocol, ObservableObject {
         return credential
     }
 
+    public func getCredentialForUrl(_ url: String) -> CredentialProtocol? {
+        return credential ?? repo.credentialsManager.getCredentialForUrl(url)
+    }
+
     public func mustSupplyCredential() {
         errorReceiver.onError(-1, nil, "Credential is required!")
     }
@@ -9,6 +9,7 @@
 
 #import <string>
 #import <map>
+#import <memory>
 
 #import "Repository.h"
 
@@ -16,28 +17,38 @@
 
 #import "internal/StringHelpers.mm"
 
+struct OIDCompare
+{
+    bool operator()(const git_oid &lhs, const git_oid &rhs) const
+    {
+        return git_oid_cmp(&lhs, &rhs) < 0;
+    }
+};
+
 #import "internal/Reference.mm"
 #import "internal/Commit.mm"
 #import "internal/Remote.mm"
 #import "internal/PushUpdate.mm"
 #import "internal/Diff.mm"
+#import "internal/InternStatistics.mm"
 
 #import "internal/RemoteHandler.mm"
+#import "internal/MultiFetchHandler.mm"
 #import "internal/DiffHandler.mm"
 #import "internal/CheckoutHandler.mm"
 #import "internal/MergeHandler.mm"
 #import "internal/IndexHandler.mm"
 #import "internal/StatusHandler.mm"
+#import "internal/DiffStatHandler.mm"
+#import "internal/PathLogHandler.mm"
+#import "internal/BlameHandler.mm"
+#import "internal/ImportHandler.mm"
+#import "internal/MaintenanceHandler.mm"
 
 static int libgit2_initialized = false;
 
-struct OIDCompare
-{
-    bool operator()(const git_oid &lhs, const git_oid &rhs) const
-    {
-        return git_oid_cmp(&lhs, &rhs) < 0;
-    }
-};
+// Maximum number of cached blame entries (ranges of lines) across all files
+static const size_t BLAME_CACHE_CAPACITY = 256 * 1024;
 
 @implementation Repository
 {
@@ -48,6 +59,20 @@ struct OIDCompare
     // Note that we should not cache created Reference because their target cannot be updated
     // after creation and so subsequent command might not work correctly.
     std::map<git_oid, Commit*, OIDCompare> _oid_to_commit;
+
+    // Changed-paths Bloom filters for path-filtered log, shared with background updates
+    std::shared_ptr<ChangedPathsIndex> _changed_paths;
+
+    // Blame results by (path, commit OID)
+    BlameCache _blame_cache;
+
+    // Diff results by (old tree, new tree, options)
+    DiffCache _diff_cache;
+
+    RenameOptions _rename_options;
+
+    // Shared strings and signatures of the model objects
+    StringInterner _interner;
 }
 
 - (nonnull instancetype)init:(nonnull NSString*)path
@@ -58,6 +83,7 @@ struct OIDCompare
 
     self->_pathToRepo = strdup([path UTF8String]);
     self->repo = NULL;
+    self->_blame_cache.setCapacity(BLAME_CACHE_CAPACITY);
 
     return self;
 }
@@ -95,7 +121,7 @@ struct OIDCompare
 
         if (git_commit_lookup(&commit, repo, &oid) == 0) {
             Commit *result = [self makeCommit];
-            [result setLibGit2Commit :commit :&oid];
+            [result setLibGit2Commit :commit :&oid :_interner];
             _oid_to_commit[oid] = result;
 
             return result;
@@ -107,6 +133,17 @@ struct OIDCompare
     return iter->second;
 }
 
+- (std::shared_ptr<ChangedPathsIndex>)changedPathsIndex
+{
+    @synchronized (self) {
+        if (_changed_paths == nullptr && repo != NULL) {
+            _changed_paths = std::make_shared<ChangedPathsIndex>(git_repository_path(repo));
+        }
+
+        return _changed_paths;
+    }
+}
+
 - (void)updateCommitParents:(nonnull Commit*)commit
 {
     if (commit->computedParents)
@@ -137,7 +174,7 @@ struct OIDCompare
     git_reference *ref;
     git_reference_lookup(&ref, repo, name);
     Reference *result = [self makeReference];
-    [result setLibGit2Reference :ref];
+    [result setLibGit2Reference :ref :_interner];
 
     return result;
 }
@@ -192,9 +229,23 @@ int addReferenceToTargetCommit(const char *name, void *payload)
     RemoteHandler(remoteProgress, checkoutProgress, errorReceiver).clone(&repo, [url UTF8String], _pathToRepo);
 }
 
+- (void)clone:(nonnull NSString*)url
+             :(nonnull NSString*)referencePath
+             :(id<RemoteProgressProtocol> _Nonnull)remoteProgress
+             :(id<CheckoutProtocol> _Nullable)checkoutProgress
+             :(id<ErrorReceiverProtocol> _Nullable)errorReceiver
+{
+    RemoteHandler(remoteProgress, checkoutProgress, errorReceiver).cloneWithReference(&repo, [url UTF8String], _pathToRepo, [referencePath UTF8String]);
+}
+
 - (void)status:(id<StatusProtocol> _Nonnull)gitStatusReceiver :(id<ErrorReceiverProtocol> _Nullable)errorReceiver
 {
-    StatusHandler(gitStatusReceiver, errorReceiver).status(repo);
+    StatusHandler(gitStatusReceiver, errorReceiver, _rename_options, _interner).status(repo);
+}
+
+- (void)statusStat:(id<DiffStatReceiverProtocol> _Nonnull)stagedReceiver :(id<DiffStatReceiverProtocol> _Nonnull)unstagedReceiver :(id<ErrorReceiverProtocol> _Nullable)errorReceiver
+{
+    DiffStatHandler(errorReceiver, _rename_options, _interner).status(repo, stagedReceiver, unstagedReceiver);
 }
 
 - (void)stage:(nonnull NSString*)path :(id<ErrorReceiverProtocol> _Nullable)errorReceiver
@@ -232,6 +283,11 @@ int addReferenceToTargetCommit(const char *name, void *payload)
     IndexHandler(errorReceiver).commit(repo, [message UTF8String]);
 }
 
+- (NSArray<OID*>* _Nullable)importCommits:(nonnull NSArray<ImportCommit*>*)commits :(id<ErrorReceiverProtocol> _Nullable)errorReceiver
+{
+    return ImportHandler(errorReceiver).import(repo, commits);
+}
+
 - (void)log:(id<CommitGraphProtocol>)commitGraph
 {
     git_revwalk *walk;
@@ -262,9 +318,104 @@ int addReferenceToTargetCommit(const char *name, void *payload)
     [self updateReferencesTargets];
 }
 
-- (void)diff:(nonnull Commit*)baseCommit :(nonnull Commit*)targetCommit :(id<DiffReceiverProtocol> _Nonnull)diffReceiver
+- (void)log:(id<CommitGraphProtocol>)commitGraph :(nonnull NSArray<NSString*>*)paths
+{
+    [commitGraph clear];
+
+    PathLogHandler([self changedPathsIndex].get(), paths).log(repo, [&](const git_oid &commit_oid) {
+        auto commit = [self getOrAddCommitByID :commit_oid];
+        if (commit != nil) {
+            [commitGraph addCommit :commit];
+        }
+    });
+
+    [self updateAllCommitsParents];
+    [self updateReferencesTargets];
+}
+
+- (void)updateChangedPathsIndex
+{
+    auto index = [self changedPathsIndex];
+    if (index == nullptr)
+        return;
+
+    // Use a dedicated handle since this is meant to run on a background thread
+    git_repository *handle;
+    if (git_repository_open(&handle, _pathToRepo) != 0)
+        return;
+
+    index->update(handle);
+
+    git_repository_free(handle);
+}
+
+- (BOOL)maintenanceIsDue
 {
-    DiffHandler(diffReceiver).diff(repo, baseCommit->commit, targetCommit->commit);
+    return repo != NULL && MaintenanceHandler::isDue(repo);
+}
+
+- (MaintenanceResult* _Nullable)maintain:(id<ErrorReceiverProtocol> _Nullable)errorReceiver
+{
+    MaintenanceHandler::Result result;
+    if (!MaintenanceHandler(errorReceiver).maintain(repo, [self changedPathsIndex].get(), result))
+        return nil;
+
+    // Let this handle forget the packs that were merged
+    git_odb *odb;
+    if (git_repository_odb(&odb, repo) == 0) {
+        git_odb_refresh(odb);
+        git_odb_free(odb);
+    }
+
+    return [[MaintenanceResult alloc] init :result.objects_packed :result.loose_objects_removed :result.packs_removed :result.bytes_reclaimed];
+}
+
+- (void)blame:(nonnull NSString*)path
+             :(nonnull Commit*)commit
+             :(id<BlameProtocol> _Nonnull)blameReceiver
+             :(id<ErrorReceiverProtocol> _Nullable)errorReceiver
+{
+    BlameHandler(blameReceiver, errorReceiver, _blame_cache, [self changedPathsIndex].get()).blame(repo, [path UTF8String], commit->commit, [&](const git_oid &oid) {
+        return [self getOrAddCommitByID :oid];
+    });
+    [blameReceiver onComplete];
+}
+
+- (void)diff:(Commit* _Nullable)baseCommit :(nonnull Commit*)targetCommit :(id<DiffReceiverProtocol> _Nonnull)diffReceiver
+{
+    DiffHandler(diffReceiver, _diff_cache, _rename_options, _interner).diff(repo, (baseCommit != nil) ? baseCommit->commit : NULL, targetCommit->commit);
+}
+
+- (void)diffStat:(Commit* _Nullable)baseCommit :(nonnull Commit*)targetCommit :(id<DiffStatReceiverProtocol> _Nonnull)receiver :(id<ErrorReceiverProtocol> _Nullable)errorReceiver
+{
+    DiffStatHandler(errorReceiver, _rename_options, _interner).diff(repo, (baseCommit != nil) ? baseCommit->commit : NULL, targetCommit->commit, receiver);
+}
+
+- (void)setDiffCacheLimit:(NSUInteger)memoryLimit :(BOOL)useDisk
+{
+    std::string disk_dir;
+    if (useDisk && repo != NULL) {
+        disk_dir = std::string(git_repository_path(repo)) + "xgit/diff-cache";
+    }
+
+    _diff_cache.configure(memoryLimit, disk_dir);
+}
+
+- (nonnull InternStatistics*)internStatistics
+{
+    size_t count, bytes, lookups, hits;
+    _interner.getStatistics(count, bytes, lookups, hits);
+
+    return [[InternStatistics alloc] init :count :bytes :lookups :hits];
+}
+
+- (void)setRenameDetection:(BOOL)findRenames :(BOOL)findCopies :(NSUInteger)renameThreshold :(NSUInteger)copyThreshold :(NSUInteger)maxComparisons
+{
+    _rename_options.find_renames = findRenames;
+    _rename_options.find_copies = findCopies;
+    _rename_options.rename_threshold = (uint16_t)MIN(renameThreshold, 100);
+    _rename_options.copy_threshold = (uint16_t)MIN(copyThreshold, 100);
+    _rename_options.max_comparisons = maxComparisons;
 }
 
 - (Commit* _Nullable)getReferenceTargetCommit:(nonnull Reference*)ref
@@ -368,4 +519,17 @@ int addReferenceToTargetCommit(const char *name, void *payload)
     RemoteHandler(remoteProgress, errorReceiver).fetch(remote->remote);
 }
 
+- (void)fetchAll:(NSArray<Remote*>* _Nullable)remotes
+                :(NSUInteger)parallelism
+                :(id<RemoteProgressProtocol> _Nonnull)remoteProgress
+                :(id<ErrorReceiverProtocol> _Nullable)errorReceiver
+{
+    std::vector<std::string> names;
+    for(Remote *remote in remotes) {
+        names.push_back([remote.name UTF8String]);
+    }
+
+    MultiFetchHandler(remoteProgress, errorReceiver).fetch(repo, (remotes != nil) ? &names : NULL, parallelism);
+}
+
 @end
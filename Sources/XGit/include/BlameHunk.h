@@ -0,0 +1,38 @@
+//
+//  BlameHunk.h
+//  Declaration of BlameHunk class which is a range of lines attributed to a commit by `git blame`
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#import "Commit.h"
+
+@interface BlameHunk: NSObject
+
+/**
+ * ID to conform to SwiftUI's Identifiable
+ */
+@property (readonly, nonnull) NSUUID *id;
+
+/**
+ * The (1-based) line number of the first line of this hunk in the blamed version of the file
+ */
+@property (readonly) NSUInteger finalStartLine;
+
+/**
+ * The number of lines in this hunk
+ */
+@property (readonly) NSUInteger lineCount;
+
+/**
+ * The (1-based) line number of the first line of this hunk in the version of the
+ * file introduced by `commit`
+ */
+@property (readonly) NSUInteger origStartLine;
+
+/**
+ * The commit that last changed the lines in this hunk
+ */
+@property (readonly, nonnull) Commit *commit;
+
+@end
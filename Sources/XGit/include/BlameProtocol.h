@@ -0,0 +1,33 @@
+//
+//  BlameProtocol.h
+//  Protocol to communicate `git blame` result
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#import "BlameHunk.h"
+
+/**
+ * Protocol for object to host the result of `git blame`. Hunks are reported as soon as
+ * their lines are attributed (newest commits first) so that the client can show the
+ * first screen before the whole history of the file is processed.
+ */
+@protocol BlameProtocol
+
+/**
+ * Invoked before any hunk with the number of lines in the blamed version of the file
+ */
+- (void)setLineCount:(NSUInteger)lineCount;
+
+/**
+ * Invoked when a range of lines has been attributed. Hunks come in no particular order
+ * and do not overlap.
+ */
+- (void)addHunk:(nonnull BlameHunk*)hunk;
+
+/**
+ * Invoked when all lines have been attributed
+ */
+- (void)onComplete;
+
+@end
@@ -28,6 +28,18 @@
  */
 @property (readonly, nonnull) DiffFile *theNewFile;
 
+/**
+ * The kind of change as in `git diff --name-status`: for example
+ *  'A' if the file is added, 'D' if deleted, 'M' if modified,
+ *  'R' if renamed from the old file, 'C' if copied from the old file.
+ */
+@property (readonly, nonnull) NSString *status;
+
+/**
+ * Similarity (0-100) between the old and new file of a rename or copy
+ */
+@property (readonly) NSUInteger similarity;
+
 /**
  * The list of diff hunks
  */
@@ -0,0 +1,45 @@
+//
+//  DiffFileStat.h
+//  Declaration of DiffFileStat class which is the numbers of changed lines in a file (a.k.a. numstat)
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+@interface DiffFileStat: NSObject
+
+/**
+ * The file path: the new path or the old path if the file is deleted
+ */
+@property (readonly, nonnull) NSString *path;
+
+/**
+ * The number of added lines
+ */
+@property (readonly) NSUInteger insertions;
+
+/**
+ * The number of deleted lines
+ */
+@property (readonly) NSUInteger deletions;
+
+/**
+ * Indicate if either version of the file is binary in which case lines are not counted
+ */
+@property (readonly) BOOL isBinary;
+
+/**
+ * Indicate if either version of the file is too large for the lines to be counted
+ */
+@property (readonly) BOOL isTooLarge;
+
+/**
+ * Size in bytes of the old version of the file (0 if the file is added)
+ */
+@property (readonly) uint64_t oldSize;
+
+/**
+ * Size in bytes of the new version of the file (0 if the file is deleted)
+ */
+@property (readonly) uint64_t newSize;
+
+@end
@@ -24,4 +24,15 @@
  */
 @property (readonly, nonnull) NSArray<DiffLine*> *lines;
 
+/**
+ * The word-level changes within the lines of this hunk, computed on the
+ * first call. Removed lines are paired in order with the added lines that
+ * immediately follow them.
+ *
+ * @return One NSData per line of `lines` holding packed uint32_t pairs
+ *         (offset, length) of the changed byte ranges in the UTF-8 encoding
+ *         of the line's text. It is empty for context and unpaired lines.
+ */
+- (nonnull NSArray<NSData*>*)intraLineChanges;
+
 @end
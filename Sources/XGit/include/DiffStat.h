@@ -0,0 +1,32 @@
+//
+//  DiffStat.h
+//  Declaration of DiffStat class which summarizes a diff by the numbers of changed lines (a.k.a. diffstat)
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#import "DiffFileStat.h"
+
+@interface DiffStat: NSObject
+
+/**
+ * Initialize an empty diffstat
+ */
+- (nonnull instancetype)init;
+
+/**
+ * The statistics of each changed file
+ */
+@property (readonly, nonnull) NSArray<DiffFileStat*> *files;
+
+/**
+ * Total number of added lines
+ */
+@property (readonly) NSUInteger insertions;
+
+/**
+ * Total number of deleted lines
+ */
+@property (readonly) NSUInteger deletions;
+
+@end
@@ -0,0 +1,14 @@
+//
+//  DiffStatReceiverProtocol.h
+//  Protocol to communicate `git diff --stat` result
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#import "DiffStat.h"
+
+@protocol DiffStatReceiverProtocol
+
+- (void)setStat:(nonnull DiffStat*)stat;
+
+@end
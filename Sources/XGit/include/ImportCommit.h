@@ -0,0 +1,54 @@
+//
+//  ImportCommit.h
+//  Declaration of ImportCommit class which describes a commit to be created by Repository's importCommits
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+@interface ImportCommit: NSObject
+
+/**
+ * Describe a new commit on top of the previous commit imported to the same
+ * reference, or on top of the reference's current target for the first one.
+ *
+ * @param refName Full name of the reference to advance, e.g. `refs/heads/main`.
+ *                The reference is created if it does not exist. A symbolic
+ *                reference such as `HEAD` advances the branch it points to.
+ * @param message The commit message
+ * @param authorName Name of the author, who is also the committer
+ * @param authorEmail Email of the author
+ * @param time The author and commit time
+ */
+- (nonnull instancetype)init:(nonnull NSString*)refName
+                            :(nonnull NSString*)message
+                            :(nonnull NSString*)authorName
+                            :(nonnull NSString*)authorEmail
+                            :(nonnull NSDate*)time;
+
+/**
+ * Add or replace a file in this commit
+ *
+ * @param path Path to the file relative to the repo root
+ * @param content The new content of the file
+ * @param executable Whether the file has the executable mode
+ */
+- (void)writeFile:(nonnull NSString*)path :(nonnull NSData*)content :(BOOL)executable;
+
+/**
+ * Remove a file in this commit. Removing a file that does not exist is ignored.
+ *
+ * @param path Path to the file relative to the repo root
+ */
+- (void)removeFile:(nonnull NSString*)path;
+
+@property (readonly, nonnull) NSString *refName;
+
+@property (readonly, nonnull) NSString *message;
+
+@property (readonly, nonnull) NSString *authorName;
+
+@property (readonly, nonnull) NSString *authorEmail;
+
+@property (readonly, nonnull) NSDate *time;
+
+@end
@@ -0,0 +1,35 @@
+//
+//  InternStatistics.h
+//  Declaration of InternStatistics class which reports the usage of a repository's table of shared strings
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+@interface InternStatistics: NSObject
+
+/**
+ * Number of distinct strings and signatures in the table
+ */
+@property (readonly) NSUInteger count;
+
+/**
+ * Total size in bytes of the distinct strings (UTF-8)
+ */
+@property (readonly) NSUInteger bytes;
+
+/**
+ * Number of strings and signatures requested by the model objects
+ */
+@property (readonly) NSUInteger lookups;
+
+/**
+ * Number of requests that were served by an existing entry
+ */
+@property (readonly) NSUInteger hits;
+
+/**
+ * Fraction of requests served by an existing entry, between 0 and 1
+ */
+@property (readonly) double hitRate;
+
+@end
@@ -0,0 +1,31 @@
+//
+//  MaintenanceResult.h
+//  Declaration of MaintenanceResult class which reports what a repository maintenance reclaimed
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+@interface MaintenanceResult: NSObject
+
+/**
+ * Number of objects written to the new pack
+ */
+@property (readonly) NSUInteger objectsPacked;
+
+/**
+ * Number of loose objects deleted because they are now packed, either in the
+ * new pack or in a pack that is kept as is
+ */
+@property (readonly) NSUInteger looseObjectsRemoved;
+
+/**
+ * Number of small packs merged into the new pack and deleted
+ */
+@property (readonly) NSUInteger packsRemoved;
+
+/**
+ * Disk space freed, net of the new pack
+ */
+@property (readonly) int64_t bytesReclaimed;
+
+@end
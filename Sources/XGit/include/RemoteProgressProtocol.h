@@ -99,4 +99,13 @@
  */
 - (void)onPushNegotiation:(nonnull NSArray<PushUpdate*> *)updates;
 
+@optional
+
+/**
+ * Invoke to retrieve the credential for the remote at `url`, for operations
+ * that talk to several remotes such as fetching all remotes. When this is not
+ * implemented, `getCredential` is used for every remote.
+ */
+- (id<CredentialProtocol> _Nullable)getCredentialForUrl:(nonnull NSString*)url;
+
 @end
@@ -12,13 +12,18 @@
 #import "Diff.h"
 #import "Remote.h"
 #import "Reference.h"
+#import "ImportCommit.h"
+#import "InternStatistics.h"
+#import "MaintenanceResult.h"
 
 #import "ErrorReceiverProtocol.h"
 #import "DiffReceiverProtocol.h"
+#import "DiffStatReceiverProtocol.h"
 #import "CheckoutProtocol.h"
 #import "MergeProtocol.h"
 #import "StatusProtocol.h"
 #import "CommitGraphProtocol.h"
+#import "BlameProtocol.h"
 #import "RemoteProgressProtocol.h"
 
 /**
@@ -102,6 +107,11 @@
  * Client code is expected to run this method in background thread
  * if necessary. Also, do not run this if the repo already exists.
  *
+ * A repository on this machine (a path or a `file://` URL) is cloned
+ * without transferring its objects: the object files are cloned
+ * (copy-on-write) or hard linked when possible, so only the checkout
+ * takes time.
+ *
  * @param url URL to the remote repository
  * @param remoteProgress Object to receive clone progress report
  * @param checkoutProgress Object to receive progress of the checkout
@@ -112,6 +122,26 @@
              :(id<CheckoutProtocol> _Nullable)checkoutProgress
              :(id<ErrorReceiverProtocol> _Nullable)errorReceiver;
 
+/**
+ * Clone a repository on this machine, borrowing the objects that a
+ * reference repository already has instead of sharing or copying them
+ * (like `git clone --reference`). The reference is recorded in
+ * `objects/info/alternates` so it must not be deleted, nor its objects
+ * pruned, while the clone is in use.
+ *
+ * @param url Path or `file://` URL to the local repository to clone
+ * @param referencePath Path to the reference repository, which can be the
+ *                      source itself (like `git clone --shared`)
+ * @param remoteProgress Object to receive clone progress report
+ * @param checkoutProgress Object to receive progress of the checkout
+ *                         step of the clone operation
+ */
+- (void)clone:(nonnull NSString*)url
+             :(nonnull NSString*)referencePath
+             :(id<RemoteProgressProtocol> _Nonnull)remoteProgress
+             :(id<CheckoutProtocol> _Nullable)checkoutProgress
+             :(id<ErrorReceiverProtocol> _Nullable)errorReceiver;
+
 /**
  * Get the repository's status such as staged files, unstaged files, etc.
  *
@@ -120,6 +150,18 @@
 - (void)status:(id<StatusProtocol> _Nonnull)gitStatusReceiver
               :(id<ErrorReceiverProtocol> _Nullable)errorReceiver;
 
+/**
+ * Count the added and deleted lines of the staged and unstaged changes
+ * (like `git diff --stat`) without producing the diff lines.
+ *
+ * @param stagedReceiver Object to receive the stat of the staged changes
+ * @param unstagedReceiver Object to receive the stat of the unstaged changes,
+ *                         including untracked files
+ */
+- (void)statusStat:(id<DiffStatReceiverProtocol> _Nonnull)stagedReceiver
+                  :(id<DiffStatReceiverProtocol> _Nonnull)unstagedReceiver
+                  :(id<ErrorReceiverProtocol> _Nullable)errorReceiver;
+
 /**
  * Stage a file to the index for the next commit
  *
@@ -156,6 +198,20 @@
 - (void)commit:(nonnull NSString*)message
               :(id<ErrorReceiverProtocol> _Nullable)errorReceiver;
 
+/**
+ * Create many commits at once, e.g. to import history from another system.
+ *
+ * Neither the index nor the working directory is used or modified. All new
+ * objects are written as a single pack and the references are only updated
+ * at the end, all together, after checking that none of them has moved in
+ * the meantime. On error, no reference is updated.
+ *
+ * @param commits The commits to create in order
+ * @return The OIDs of the created commits, or nil on error
+ */
+- (NSArray<OID*>* _Nullable)importCommits:(nonnull NSArray<ImportCommit*>*)commits
+                                         :(id<ErrorReceiverProtocol> _Nullable)errorReceiver;
+
 /**
  * Retrieve the revision history as a list of commits ordered by time
  * and by topology.
@@ -164,17 +220,139 @@
  */
 - (void)log:(id<CommitGraphProtocol> _Nonnull)commitGraph;
 
+/**
+ * Retrieve the history of some files or directories, simplified like
+ * `git log -- <paths>`: Only commits that change at least one of the
+ * paths are added and a merge that does not change them compared to
+ * one of its parents only has that parent followed.
+ *
+ * Paths are plain paths relative to the repo root (no wildcard).
+ * The walk is accelerated by the changed-paths index, see
+ * `updateChangedPathsIndex`, and falls back to comparing trees for
+ * commits that are not indexed yet.
+ *
+ * @param commitGraph Instance of a commit graph, ready to be filled up
+ * @param paths The files or directories whose history to retrieve
+ */
+- (void)log:(id<CommitGraphProtocol> _Nonnull)commitGraph
+           :(nonnull NSArray<NSString*>*)paths;
+
+/**
+ * Index the commits reachable from the references that are not yet
+ * in the changed-paths Bloom filter index stored in `.git/xgit`.
+ * The work is incremental and uses its own repository handle so
+ * client should run this method in a background thread, for example
+ * after `log` or `fetch`.
+ */
+- (void)updateChangedPathsIndex;
+
+/**
+ * Check cheaply whether there are enough loose objects or packs for
+ * `maintain` to be worthwhile, with the same limits as `git gc --auto`.
+ */
+- (BOOL)maintenanceIsDue;
+
+/**
+ * Compact the repository: pack the loose objects together with the small
+ * packs (e.g. from fetches) into a new pack, then delete the loose objects
+ * and packs it replaces. Also compact the changed-paths index and trim the
+ * on-disk diff cache. No object is ever dropped.
+ *
+ * It is safe to keep using the repository, also from other processes, while
+ * this runs on a background thread. Only one maintenance runs at a time.
+ *
+ * @return What was reclaimed, or nil on error
+ */
+- (MaintenanceResult* _Nullable)maintain:(id<ErrorReceiverProtocol> _Nullable)errorReceiver;
+
+/**
+ * Attribute each line of a file to the commit that last changed it
+ * a.k.a. `git blame`. Ranges of lines are reported as soon as they are
+ * attributed. Results are cached by (path, commit) so that blaming the
+ * file again at a newer commit only processes the commits in between.
+ *
+ * Like `log` and `status`, this must be called on the thread that uses the
+ * repository: it shares the repository handle and the commit objects.
+ *
+ * @param path Path to the file relative to the repo root
+ * @param commit The commit at which to blame the file
+ * @param blameReceiver Object to progressively receive the blame result
+ */
+- (void)blame:(nonnull NSString*)path
+             :(nonnull Commit*)commit
+             :(id<BlameProtocol> _Nonnull)blameReceiver
+             :(id<ErrorReceiverProtocol> _Nullable)errorReceiver;
+
 /**
  * Compute the diff between two commits
  *
- * @param baseCommit The base commit
+ * Results are cached by the pair of commit trees so flipping between
+ * the same commits does not recompute the diff, see `setDiffCacheLimit`.
+ *
+ * @param baseCommit The base commit or nil to diff against the empty
+ *                   tree (e.g. to show the changes of a root commit)
  * @param targetCommit The target commit
  * @param diffReceiver Object to receive the diff result
  */
-- (void)diff:(nonnull Commit*)baseCommit
+- (void)diff:(Commit* _Nullable)baseCommit
             :(nonnull Commit*)targetCommit
             :(id<DiffReceiverProtocol> _Nonnull)diffReceiver;
 
+/**
+ * Count the added and deleted lines per file between two commits (like
+ * `git diff --numstat`) without producing the diff lines. Binary files
+ * and files over 16MB are reported without line counts.
+ *
+ * @param baseCommit The base commit or nil to diff against the empty tree
+ * @param targetCommit The target commit
+ * @param receiver Object to receive the stat
+ */
+- (void)diffStat:(Commit* _Nullable)baseCommit
+                :(nonnull Commit*)targetCommit
+                :(id<DiffStatReceiverProtocol> _Nonnull)receiver
+                :(id<ErrorReceiverProtocol> _Nullable)errorReceiver;
+
+/**
+ * Configure the cache of `diff` results. By default, up to 32MB of diffs
+ * are kept in memory only.
+ *
+ * @param memoryLimit Maximum total size in bytes of the diffs kept in
+ *                    memory, 0 to disable the memory cache
+ * @param useDisk Also persist the diffs in `.git/xgit/diff-cache` (up to
+ *                64MB) so that they survive the repository object. Must be
+ *                called after the repository is opened.
+ */
+- (void)setDiffCacheLimit:(NSUInteger)memoryLimit :(BOOL)useDisk;
+
+/**
+ * Get the usage of the table of strings (author names and emails, reference
+ * names, file paths) shared by the commits, references and diffs of this
+ * repository
+ */
+- (nonnull InternStatistics*)internStatistics;
+
+/**
+ * Configure rename and copy detection in `diff`, `diffStat`, `status` and
+ * `statusStat`. By default, renames with a similarity of at least 50% are
+ * detected but copies are not.
+ *
+ * Files with identical content are always paired first, which is cheap.
+ * The remaining files are compared by content only if the number of
+ * (added, deleted) file pairs is at most `maxComparisons`, like git's
+ * `diff.renameLimit`, so that huge moves stay cheap.
+ *
+ * @param findRenames Whether to detect renames at all
+ * @param findCopies Whether to also detect copies of modified files
+ * @param renameThreshold Minimum similarity (0-100) to report a rename
+ * @param copyThreshold Minimum similarity (0-100) to report a copy
+ * @param maxComparisons Maximum number of pairs of files compared by content
+ */
+- (void)setRenameDetection:(BOOL)findRenames
+                          :(BOOL)findCopies
+                          :(NSUInteger)renameThreshold
+                          :(NSUInteger)copyThreshold
+                          :(NSUInteger)maxComparisons;
+
 /**
  * Create a new local-tracking branch pointing at the given commit.
  *
@@ -301,4 +479,25 @@
              :(id<RemoteProgressProtocol> _Nonnull)remoteProgress
              :(id<ErrorReceiverProtocol> _Nullable)errorReceiver;
 
+/**
+ * Fetch changes from several remotes concurrently (like `git fetch --multiple`).
+ *
+ * Objects are downloaded in parallel, then the remote-tracking references of
+ * all remotes are updated one remote after another once every download has
+ * finished. A remote that fails to download is reported to the error receiver
+ * and its references are left untouched; FETCH_HEAD is not written.
+ *
+ * @param remotes The remotes to fetch, or nil to fetch all configured remotes.
+ *                An empty array fetches nothing.
+ * @param parallelism Maximum number of simultaneous downloads, 0 for a default
+ * @param remoteProgress Object to receive the progress summed over all
+ *                       remotes; `onComplete` is invoked once at the end.
+ *                       The credential of each remote is requested with
+ *                       `getCredentialForUrl` when implemented.
+ */
+- (void)fetchAll:(NSArray<Remote*>* _Nullable)remotes
+                :(NSUInteger)parallelism
+                :(id<RemoteProgressProtocol> _Nonnull)remoteProgress
+                :(id<ErrorReceiverProtocol> _Nullable)errorReceiver;
+
 @end
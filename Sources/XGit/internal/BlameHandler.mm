@@ -0,0 +1,389 @@
+//
+//  BlameHandler.mm
+//  Single-use struct to perform git blame
+//
+//  Lines of the blamed file are tracked as ranges owned by a "suspect" commit. Starting
+//  from the blamed commit, the newest suspect passes every line it shares with a parent
+//  to that parent; the remaining lines are attributed to the suspect and reported right
+//  away. Like git, a merge passes all its lines to the first parent with the same file
+//  content, if any, before splitting them among the parents by diff. Completed results
+//  are cached by (path, commit) so that re-blaming after new commits stops as soon as it
+//  reaches a commit blamed before.
+//
+//  The handler uses the repository's handle, commit map and blame cache, none of which
+//  is thread-safe, so it runs on the thread that owns the repository.
+//
+//  Renames are not followed: lines are attributed to the commit that added the path.
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+#import "BlameProtocol.h"
+#import "BlameHunk.mm"
+#import "GitErrorReporter.mm"
+#import "ChangedPathsIndex.mm"
+#import "LRUCache.mm"
+#import "ByteScanner.mm"
+
+/** A range of lines attributed to a commit, all line numbers are 0-based */
+struct BlameEntry {
+    size_t final_start;
+    size_t count;
+    size_t orig_start;
+    git_oid commit_oid;
+};
+
+struct BlameKey {
+    std::string path;
+    git_oid commit_oid;
+};
+
+struct BlameKeyCompare {
+    bool operator()(const BlameKey &lhs, const BlameKey &rhs) const {
+        int c = lhs.path.compare(rhs.path);
+        if (c != 0)
+            return c < 0;
+
+        return git_oid_cmp(&lhs.commit_oid, &rhs.commit_oid) < 0;
+    }
+};
+
+/** Cache of complete blame results, sorted by final_start and costed by number of entries */
+typedef LRUCache<BlameKey, std::vector<BlameEntry>, BlameKeyCompare> BlameCache;
+
+struct BlameHandler: GitErrorReporter {
+
+    BlameHandler(id<BlameProtocol> blameReceiver, id<ErrorReceiverProtocol> errorReceiver,
+                 BlameCache &cache, ChangedPathsIndex * _Nullable index):
+        GitErrorReporter(errorReceiver),
+        cache(cache) {
+        this->blameReceiver = blameReceiver;
+        this->index = index;
+    }
+
+    ~BlameHandler() {
+        git_blob_free(final_blob);
+    }
+
+    /**
+     * @param lookupCommit Function returning the (cached) Commit of an OID
+     */
+    void blame(git_repository *repo, const char *path, git_commit *commit, std::function<Commit*(const git_oid&)> lookupCommit) {
+        this->repo = repo;
+        this->path = ChangedPathsIndex::normalizePath(path);
+        this->paths.push_back(this->path);
+        this->lookupCommit = lookupCommit;
+
+        git_oid blob_oid;
+        if (!findBlob(commit, blob_oid, true))
+            return;
+
+        if (reportError(git_blob_lookup(&final_blob, repo, &blob_oid), "Blame: Cannot load the file content"))
+            return;
+
+        auto line_count = ByteScanner::countLines((const char*)git_blob_rawcontent(final_blob), (size_t)git_blob_rawsize(final_blob));
+        [blameReceiver setLineCount :line_count];
+
+        if (line_count > 0) {
+            std::vector<Range> ranges { Range { 0, 0, line_count } };
+            passTo(*git_commit_id(commit), git_commit_time(commit), blob_oid, ranges);
+        }
+
+        // Process the newest suspect first so that a commit receives lines from
+        // all its children before being processed
+        while (!queue.empty()) {
+            auto newest = suspects.find(queue.top().commit_oid);
+            queue.pop();
+
+            Suspect suspect = std::move(newest->second);
+            suspects.erase(newest);
+
+            process(suspect);
+        }
+
+        cacheResult(*git_commit_id(commit));
+    }
+
+private:
+    id<BlameProtocol> blameReceiver;
+    BlameCache &cache;
+    ChangedPathsIndex *index;
+
+    git_repository *repo = NULL;
+    std::string path;
+    std::vector<std::string> paths;
+    std::function<Commit*(const git_oid&)> lookupCommit;
+    git_blob *final_blob = NULL;
+
+    /** Lines [start, start + count) of the suspect's version are lines [final_start, ...) of the final file */
+    struct Range {
+        size_t final_start;
+        size_t start;
+        size_t count;
+    };
+
+    struct Suspect {
+        git_oid commit_oid;
+        git_oid blob_oid;
+        int64_t time;
+        std::vector<Range> ranges;
+    };
+
+    /** Lines [new_start, new_start + count) of a file are the same as [old_start, ...) of the other */
+    struct Block {
+        size_t old_start;
+        size_t new_start;
+        size_t count;
+    };
+
+    /** Entry of the queue of suspects, ordered by commit time (newest on top) */
+    struct QueueEntry {
+        int64_t time;
+        git_oid commit_oid;
+
+        bool operator<(const QueueEntry &other) const {
+            if (time != other.time)
+                return time < other.time;
+
+            return git_oid_cmp(&commit_oid, &other.commit_oid) < 0;
+        }
+    };
+
+    std::map<git_oid, Suspect, OIDCompare> suspects;
+    std::priority_queue<QueueEntry> queue;
+    std::vector<BlameEntry> result;
+
+    void process(Suspect &suspect) {
+        const git_oid commit_oid = suspect.commit_oid;
+
+        auto cached = cache.get(BlameKey { path, commit_oid });
+        if (cached != NULL) {
+            attributeFromCache(suspect, *cached);
+            return;
+        }
+
+        Commit *commit = lookupCommit(commit_oid);
+        if (commit != nil) {
+            struct Parent {
+                const git_oid *commit_oid;
+                int64_t time;
+                git_oid blob_oid;
+            };
+
+            // Parents that have the file
+            std::vector<Parent> parents;
+            auto num_parents = git_commit_parentcount(commit->commit);
+            for(unsigned int i = 0; i < num_parents; i++) {
+                const git_oid *parent_oid = git_commit_parent_id(commit->commit, i);
+                Commit *parent = lookupCommit(*parent_oid);
+                if (parent == nil)
+                    continue;
+
+                // The changed-paths filters let us skip loading both trees for most commits
+                Parent p { parent_oid, git_commit_time(parent->commit) };
+                if (i == 0 && index != NULL && index->query(commit_oid, paths) == ChangedPathsIndex::NOT_CHANGED) {
+                    p.blob_oid = suspect.blob_oid;
+                } else if (!findBlob(parent->commit, p.blob_oid, false)) {
+                    continue;
+                }
+
+                parents.push_back(p);
+            }
+
+            // A parent with the same content takes everything: the merge did not change the file
+            auto same = std::find_if(parents.begin(), parents.end(), [&suspect](const Parent &p) {
+                return git_oid_equal(&p.blob_oid, &suspect.blob_oid);
+            });
+            if (same != parents.end()) {
+                passTo(*same->commit_oid, same->time, same->blob_oid, suspect.ranges);
+                suspect.ranges.clear();
+            }
+
+            for(auto iter = parents.begin(); iter != parents.end() && !suspect.ranges.empty(); iter++) {
+                std::vector<Range> passed, kept;
+                split(suspect.ranges, unchangedBlocks(iter->blob_oid, suspect.blob_oid), passed, kept);
+                passTo(*iter->commit_oid, iter->time, iter->blob_oid, passed);
+                suspect.ranges.swap(kept);
+            }
+        }
+
+        for(const auto &r : suspect.ranges) {
+            attribute(BlameEntry { r.final_start, r.count, r.start, commit_oid });
+        }
+    }
+
+    void passTo(const git_oid &commit_oid, int64_t time, const git_oid &blob_oid, const std::vector<Range> &ranges) {
+        if (ranges.empty())
+            return;
+
+        auto iter = suspects.find(commit_oid);
+        if (iter == suspects.end()) {
+            suspects[commit_oid] = Suspect { commit_oid, blob_oid, time, ranges };
+            queue.push(QueueEntry { time, commit_oid });
+        } else {
+            iter->second.ranges.insert(iter->second.ranges.end(), ranges.begin(), ranges.end());
+        }
+    }
+
+    /** Split the ranges into those covered by the blocks (mapped to the old file) and the rest */
+    static void split(const std::vector<Range> &ranges, const std::vector<Block> &blocks,
+                      std::vector<Range> &passed, std::vector<Range> &kept) {
+        for(const auto &r : ranges) {
+            size_t pos = r.start, end = r.start + r.count;
+
+            // Blocks are sorted so skip to the first one that could overlap
+            auto block = std::upper_bound(blocks.begin(), blocks.end(), pos, [](size_t line, const Block &b) {
+                return line < b.new_start;
+            });
+            if (block != blocks.begin())
+                block--;
+
+            for(; block != blocks.end() && pos < end; block++) {
+                size_t block_end = block->new_start + block->count;
+                if (block_end <= pos)
+                    continue;
+                if (block->new_start >= end)
+                    break;
+
+                if (block->new_start > pos) {
+                    kept.push_back(Range { r.final_start + (pos - r.start), pos, block->new_start - pos });
+                    pos = block->new_start;
+                }
+
+                size_t stop = std::min(end, block_end);
+                passed.push_back(Range { r.final_start + (pos - r.start), block->old_start + (pos - block->new_start), stop - pos });
+                pos = stop;
+            }
+
+            if (pos < end) {
+                kept.push_back(Range { r.final_start + (pos - r.start), pos, end - pos });
+            }
+        }
+    }
+
+    std::vector<Block> unchangedBlocks(const git_oid &old_oid, const git_oid &new_oid) {
+        std::vector<Block> blocks;
+        std::vector<git_diff_hunk> hunks;
+        git_blob *old_blob = NULL, *new_blob = NULL;
+
+        if (git_blob_lookup(&old_blob, repo, &old_oid) == 0 &&
+            git_blob_lookup(&new_blob, repo, &new_oid) == 0) {
+            git_diff_options diff_opts;
+            git_diff_options_init(&diff_opts, GIT_DIFF_OPTIONS_VERSION);
+            diff_opts.context_lines = 0;
+            diff_opts.interhunk_lines = 0;
+            diff_opts.flags |= GIT_DIFF_FORCE_TEXT;
+
+            if (git_diff_blobs(old_blob, path.c_str(), new_blob, path.c_str(), &diff_opts,
+                               NULL, NULL, collect_hunk, NULL, &hunks) == 0) {
+                // Lines between hunks (there is no context) are unchanged. Note that
+                // an empty side of a hunk starts AFTER the given line.
+                size_t old_pos = 0, new_pos = 0;
+                for(const auto &h : hunks) {
+                    size_t old_begin = (h.old_lines == 0) ? h.old_start : h.old_start - 1;
+                    size_t new_begin = (h.new_lines == 0) ? h.new_start : h.new_start - 1;
+                    if (new_begin > new_pos) {
+                        blocks.push_back(Block { old_pos, new_pos, new_begin - new_pos });
+                    }
+                    old_pos = old_begin + h.old_lines;
+                    new_pos = new_begin + h.new_lines;
+                }
+                // Ranges never go past the end of the file so the last block is unbounded
+                blocks.push_back(Block { old_pos, new_pos, SIZE_MAX - new_pos });
+            }
+        }
+
+        git_blob_free(old_blob);
+        git_blob_free(new_blob);
+
+        return blocks;
+    }
+
+    static int collect_hunk(const git_diff_delta *delta, const git_diff_hunk *hunk, void *payload) {
+        ((std::vector<git_diff_hunk>*)payload)->push_back(*hunk);
+
+        return 0;
+    }
+
+    void attributeFromCache(const Suspect &suspect, const std::vector<BlameEntry> &cached) {
+        for(const auto &r : suspect.ranges) {
+            size_t pos = r.start, end = r.start + r.count;
+
+            auto entry = std::upper_bound(cached.begin(), cached.end(), pos, [](size_t line, const BlameEntry &e) {
+                return line < e.final_start;
+            });
+            if (entry != cached.begin())
+                entry--;
+
+            for(; entry != cached.end() && pos < end; entry++) {
+                size_t entry_end = entry->final_start + entry->count;
+                if (entry_end <= pos || entry->final_start > pos)
+                    continue;
+
+                size_t stop = std::min(end, entry_end);
+                attribute(BlameEntry { r.final_start + (pos - r.start), stop - pos,
+                                       entry->orig_start + (pos - entry->final_start), entry->commit_oid });
+                pos = stop;
+            }
+        }
+    }
+
+    void attribute(const BlameEntry &entry) {
+        result.push_back(entry);
+
+        Commit *commit = lookupCommit(entry.commit_oid);
+        if (commit != nil) {
+            [blameReceiver addHunk :[[BlameHunk alloc] init :entry.final_start :entry.count :entry.orig_start :commit]];
+        }
+    }
+
+    void cacheResult(const git_oid &commit_oid) {
+        std::sort(result.begin(), result.end(), [](const BlameEntry &a, const BlameEntry &b) {
+            return a.final_start < b.final_start;
+        });
+
+        // Coalesce consecutive lines coming from consecutive lines of the same commit
+        std::vector<BlameEntry> entries;
+        for(const auto &e : result) {
+            if (!entries.empty()) {
+                auto &last = entries.back();
+                if (git_oid_equal(&last.commit_oid, &e.commit_oid) &&
+                    last.final_start + last.count == e.final_start &&
+                    last.orig_start + last.count == e.orig_start) {
+                    last.count += e.count;
+                    continue;
+                }
+            }
+            entries.push_back(e);
+        }
+
+        auto cost = entries.size() + 1;
+        cache.put(BlameKey { path, commit_oid }, std::move(entries), cost);
+    }
+
+    bool findBlob(git_commit *commit, git_oid &blob_oid, bool report) {
+        git_tree *tree = NULL;
+        git_tree_entry *entry = NULL;
+        bool found = false;
+
+        int error = git_commit_tree(&tree, commit);
+        if (error == 0)
+            error = git_tree_entry_bypath(&entry, tree, path.c_str());
+
+        if (error == 0 && git_tree_entry_type(entry) == GIT_OBJECT_BLOB) {
+            blob_oid = *git_tree_entry_id(entry);
+            found = true;
+        } else if (report) {
+            reportError(error != 0 ? error : GIT_ENOTFOUND, "Blame: The path is not a file in the commit");
+        }
+
+        git_tree_entry_free(entry);
+        git_tree_free(tree);
+
+        return found;
+    }
+};
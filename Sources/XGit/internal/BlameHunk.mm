@@ -0,0 +1,23 @@
+//
+//  BlameHunk.mm
+//  Implementation of Objective-C class BlameHunk
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+@implementation BlameHunk
+{
+}
+
+- (nonnull instancetype)init:(size_t)finalStart :(size_t)count :(size_t)origStart :(nonnull Commit*)commit
+{
+    self->_id = [[NSUUID alloc] init];
+    self->_finalStartLine = finalStart + 1;
+    self->_lineCount = count;
+    self->_origStartLine = origStart + 1;
+    self->_commit = commit;
+
+    return self;
+}
+
+@end
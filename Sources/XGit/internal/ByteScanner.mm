@@ -0,0 +1,182 @@
+//
+//  ByteScanner.mm
+//  Vectorized scanning of file contents (line counting, binary detection, word boundaries)
+//
+//  Uses NEON on arm64 and SSE2 on x86_64 and falls back to scalar code elsewhere.
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <cstring>
+#include <cstdint>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+struct ByteScanner {
+
+    /**
+     * Number of occurrences of the byte in the buffer
+     */
+    static size_t count(const char *data, size_t size, char c) {
+        size_t result = 0, i = 0;
+
+#if defined(__aarch64__)
+        const uint8x16_t needle = vdupq_n_u8((uint8_t)c);
+        while (size - i >= 16) {
+            // Each lane counts up to 255 matches before we widen and sum
+            size_t blocks = (size - i) / 16;
+            if (blocks > 255)
+                blocks = 255;
+
+            uint8x16_t acc = vdupq_n_u8(0);
+            for(size_t b = 0; b < blocks; b++, i += 16) {
+                uint8x16_t v = vld1q_u8((const uint8_t*)data + i);
+                acc = vsubq_u8(acc, vceqq_u8(v, needle)); // A match is 0xFF i.e. -1
+            }
+            result += vaddlvq_u8(acc);
+        }
+#elif defined(__SSE2__)
+        const __m128i needle = _mm_set1_epi8(c);
+        for(; size - i >= 16; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+            result += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)));
+        }
+#endif
+
+        for(; i < size; i++) {
+            result += (data[i] == c);
+        }
+
+        return result;
+    }
+
+    /**
+     * Check if the byte occurs in the buffer
+     */
+    static bool contains(const char *data, size_t size, char c) {
+        size_t i = 0;
+
+#if defined(__aarch64__)
+        const uint8x16_t needle = vdupq_n_u8((uint8_t)c);
+        for(; size - i >= 16; i += 16) {
+            uint8x16_t v = vld1q_u8((const uint8_t*)data + i);
+            if (vmaxvq_u8(vceqq_u8(v, needle)) != 0)
+                return true;
+        }
+#elif defined(__SSE2__)
+        const __m128i needle = _mm_set1_epi8(c);
+        for(; size - i >= 16; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)) != 0)
+                return true;
+        }
+#endif
+
+        return memchr(data + i, c, size - i) != NULL;
+    }
+
+    /**
+     * Number of lines, counting the last line even if it has no line feed
+     */
+    static size_t countLines(const char *data, size_t size) {
+        if (size == 0)
+            return 0;
+
+        return count(data, size, '\n') + (data[size - 1] != '\n' ? 1 : 0);
+    }
+
+    /**
+     * Same heuristic as git: content is binary if there is a NUL byte in the first 8000 bytes
+     */
+    static bool isBinary(const char *data, size_t size) {
+        return contains(data, size < BINARY_CHECK_SIZE ? size : BINARY_CHECK_SIZE, '\0');
+    }
+
+    /**
+     * Word bytes are ASCII letters, digits, underscore and all non-ASCII bytes so that
+     * UTF-8 sequences are never split
+     */
+    static bool isWordByte(char c) {
+        uint8_t b = (uint8_t)c;
+        return (uint8_t)((b | 0x20) - 'a') <= 'z' - 'a' || (uint8_t)(b - '0') <= 9 || b == '_' || b >= 0x80;
+    }
+
+    static bool isSpaceByte(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    /**
+     * Index of the first byte at or after `start` that is not a word byte, or `size`
+     */
+    static size_t skipWord(const char *data, size_t size, size_t start) {
+        size_t i = start;
+
+#if defined(__aarch64__)
+        for(; size - i >= 16; i += 16) {
+            uint8x16_t v = vld1q_u8((const uint8_t*)data + i);
+            uint8x16_t letter = vcleq_u8(vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8('a')), vdupq_n_u8('z' - 'a'));
+            uint8x16_t digit = vcleq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(9));
+            uint8x16_t other = vorrq_u8(vceqq_u8(v, vdupq_n_u8('_')), vcgeq_u8(v, vdupq_n_u8(0x80)));
+            if (vminvq_u8(vorrq_u8(vorrq_u8(letter, digit), other)) == 0)
+                break;
+        }
+#elif defined(__SSE2__)
+        for(; size - i >= 16; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+            __m128i letter = inRange(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+            __m128i digit = inRange(v, '0', '9');
+            __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+            // Non-ASCII bytes have their sign bit set which movemask picks up directly
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), underscore)) | _mm_movemask_epi8(v);
+            if (mask != 0xFFFF)
+                break;
+        }
+#endif
+
+        for(; i < size && isWordByte(data[i]); i++);
+
+        return i;
+    }
+
+    /**
+     * Index of the first byte at or after `start` that is not white space, or `size`
+     */
+    static size_t skipSpace(const char *data, size_t size, size_t start) {
+        size_t i = start;
+
+#if defined(__aarch64__)
+        for(; size - i >= 16; i += 16) {
+            uint8x16_t v = vld1q_u8((const uint8_t*)data + i);
+            uint8x16_t space = vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')), vceqq_u8(v, vdupq_n_u8('\t')));
+            if (vminvq_u8(space) == 0)
+                break;
+        }
+#elif defined(__SSE2__)
+        for(; size - i >= 16; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+            __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+            if (_mm_movemask_epi8(space) != 0xFFFF)
+                break;
+        }
+#endif
+
+        for(; i < size && isSpaceByte(data[i]); i++);
+
+        return i;
+    }
+
+private:
+    static const size_t BINARY_CHECK_SIZE = 8000;
+
+#if !defined(__aarch64__) && defined(__SSE2__)
+    /** Lanes set to 0xFF where lo <= v <= hi, as unsigned bytes */
+    static __m128i inRange(__m128i v, char lo, char hi) {
+        __m128i offset = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+        return _mm_cmpeq_epi8(_mm_subs_epu8(offset, _mm_set1_epi8(hi - lo)), _mm_setzero_si128());
+    }
+#endif
+};
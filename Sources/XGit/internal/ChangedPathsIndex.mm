@@ -0,0 +1,484 @@
+//
+//  ChangedPathsIndex.mm
+//  Persisted per-commit changed-paths Bloom filters to accelerate path-filtered history
+//
+//  Each filter records the paths (and their leading directories) that a commit changes
+//  with respect to its first parent so that most commits can be rejected without
+//  loading any tree. The index is stored at `.git/xgit/changed-paths` and is extended
+//  incrementally: only commits without a filter are ever diffed.
+//
+//  The file is never modified in place. Writers take `changed-paths.lock` (created
+//  exclusively, like git's lock files), write the merged index into it and rename it over
+//  the index, so processes sharing the repository neither interleave nor lose entries.
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+struct BloomFilter {
+    static const int NUM_HASHES = 7;
+    static const size_t BITS_PER_ENTRY = 10;
+    static const size_t MIN_BITS = 64;
+
+    // Commits changing more paths than this get a filter that matches everything,
+    // same as `git commit-graph write --changed-paths`.
+    static const size_t MAX_CHANGED_PATHS = 512;
+
+    std::vector<uint8_t> bits;
+    bool tooLarge = false;
+
+    BloomFilter() {
+    }
+
+    BloomFilter(const std::set<std::string> &paths) {
+        if (paths.size() > MAX_CHANGED_PATHS) {
+            tooLarge = true;
+            return;
+        }
+
+        if (paths.empty())
+            return;
+
+        size_t num_bits = paths.size() * BITS_PER_ENTRY;
+        if (num_bits < MIN_BITS)
+            num_bits = MIN_BITS;
+        bits.assign((num_bits + 7) / 8, 0);
+        for(const auto &path : paths) {
+            add(path.c_str(), path.size());
+        }
+    }
+
+    bool mayContain(const char *path, size_t length) const {
+        if (tooLarge)
+            return true;
+
+        if (bits.empty())
+            return false;
+
+        uint32_t h1, h2;
+        hash(path, length, h1, h2);
+        size_t num_bits = bits.size() * 8;
+        for(int i = 0; i < NUM_HASHES; i++) {
+            size_t bit = (h1 + (uint32_t)i * h2) % num_bits;
+            if (!(bits[bit / 8] & (1 << (bit % 8))))
+                return false;
+        }
+
+        return true;
+    }
+
+private:
+    void add(const char *path, size_t length) {
+        uint32_t h1, h2;
+        hash(path, length, h1, h2);
+        size_t num_bits = bits.size() * 8;
+        for(int i = 0; i < NUM_HASHES; i++) {
+            size_t bit = (h1 + (uint32_t)i * h2) % num_bits;
+            bits[bit / 8] |= (1 << (bit % 8));
+        }
+    }
+
+    // FNV-1a followed by the MurmurHash3 finalizer, split into the two
+    // halves used for double hashing
+    static void hash(const char *data, size_t length, uint32_t &h1, uint32_t &h2) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for(size_t i = 0; i < length; i++) {
+            h ^= (uint8_t)data[i];
+            h *= 0x100000001b3ULL;
+        }
+
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+
+        h1 = (uint32_t)h;
+        h2 = (uint32_t)(h >> 32) | 1;
+    }
+};
+
+struct ChangedPathsIndex {
+
+    enum Answer {
+        UNKNOWN,        // No filter for this commit yet
+        NOT_CHANGED,    // None of the paths changed w.r.t. the first parent
+        MAYBE_CHANGED   // At least one of the paths might have changed
+    };
+
+    /**
+     * @param git_dir Path to the `.git` directory as returned by git_repository_path
+     */
+    ChangedPathsIndex(const char *git_dir) {
+        dir_path = std::string(git_dir) + "xgit";
+        file_path = dir_path + "/changed-paths";
+    }
+
+    /**
+     * Check if any of the (normalized) paths might have been changed by the commit
+     * with respect to its first parent.
+     */
+    Answer query(const git_oid &commit_oid, const std::vector<std::string> &paths) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ensureLoaded();
+
+        auto iter = filters.find(commit_oid);
+        if (iter == filters.end())
+            return UNKNOWN;
+
+        for(const auto &path : paths) {
+            if (iter->second.mayContain(path.c_str(), path.size()))
+                return MAYBE_CHANGED;
+        }
+
+        return NOT_CHANGED;
+    }
+
+    /**
+     * Compute the filters for all commits reachable from the references that are not
+     * yet indexed and save them to the index file. Returns immediately if another
+     * update is already running. Pass a repository handle owned by the calling thread.
+     */
+    void update(git_repository *repo) {
+        std::unique_lock<std::mutex> updating(update_mutex, std::try_to_lock);
+        if (!updating.owns_lock())
+            return;
+
+        git_revwalk *walk;
+        if (git_revwalk_new(&walk, repo) != 0)
+            return;
+
+        git_reference_foreach_name(repo, [](const char *name, void *payload) {
+            git_revwalk_push_ref((git_revwalk*) payload, name);
+
+            return 0;
+        }, walk);
+
+        std::vector<std::pair<git_oid, BloomFilter>> pending;
+
+        git_oid commit_oid;
+        while (git_revwalk_next(&commit_oid, walk) == 0) {
+            if (contains(commit_oid))
+                continue;
+
+            BloomFilter filter;
+            if (!computeFilter(repo, commit_oid, filter))
+                continue;
+
+            pending.push_back(std::make_pair(commit_oid, filter));
+
+            // Flush periodically so that an interrupted update is not entirely lost. Each
+            // flush rewrites the whole file so the batches grow with the index.
+            if (pending.size() >= FLUSH_BATCH_SIZE && pending.size() >= indexedCount()) {
+                flush(pending);
+            }
+        }
+
+        flush(pending);
+
+        git_revwalk_free(walk);
+    }
+
+    /**
+     * Rewrite the index file keeping a single entry for each commit that still exists
+     * (e.g. dropping the commits pruned after a rebase) and no truncated tail. The new
+     * file replaces the old one atomically so readers see either of them.
+     *
+     * @return Number of bytes reclaimed
+     */
+    int64_t rewrite(git_repository *repo) {
+        std::lock_guard<std::mutex> updating(update_mutex);
+        std::lock_guard<std::mutex> lock(mutex);
+        ensureLoaded();
+
+        struct stat st;
+        if (stat(file_path.c_str(), &st) != 0)
+            return 0;
+        int64_t old_size = st.st_size;
+
+        git_odb *odb;
+        if (git_repository_odb(&odb, repo) != 0)
+            return 0;
+
+        int fd = lockFile();
+        if (fd < 0) {
+            git_odb_free(odb);
+            return 0;
+        }
+
+        readFile();
+        for(auto iter = filters.begin(); iter != filters.end();) {
+            if (git_odb_exists(odb, &iter->first))
+                ++iter;
+            else
+                iter = filters.erase(iter);
+        }
+        git_odb_free(odb);
+
+        if (!commitFile(fd))
+            return 0;
+        dirty = false;
+
+        if (stat(file_path.c_str(), &st) != 0)
+            return 0;
+
+        return old_size - st.st_size;
+    }
+
+    /**
+     * Normalize a user-supplied path spec: strip leading `./` and surrounding slashes
+     */
+    static std::string normalizePath(const char *path) {
+        std::string result(path);
+
+        while (result.compare(0, 2, "./") == 0)
+            result.erase(0, 2);
+        while (!result.empty() && result.front() == '/')
+            result.erase(0, 1);
+        while (!result.empty() && result.back() == '/')
+            result.pop_back();
+
+        return result;
+    }
+
+private:
+    static const size_t FLUSH_BATCH_SIZE = 1000;
+    static const uint32_t VERSION = 1;
+
+    // A lock older than this was left by a crashed process; writing takes far less
+    static const time_t STALE_LOCK_AGE = 10 * 60;
+
+    std::string dir_path;
+    std::string file_path;
+
+    std::mutex mutex;        // Guard filters
+    std::mutex update_mutex; // Serialize writers of the index file
+    bool loaded = false;
+    std::map<git_oid, BloomFilter, OIDCompare> filters;
+
+    // Whether filters has entries that are not in the index file yet
+    bool dirty = false;
+
+    bool contains(const git_oid &commit_oid) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ensureLoaded();
+
+        return filters.find(commit_oid) != filters.end();
+    }
+
+    size_t indexedCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return filters.size();
+    }
+
+    /**
+     * Add the filters to the index and save it. If another process holds the lock, the
+     * filters stay in memory, marked as unsaved, and are saved with the next flush (the
+     * one at the end of the next update at the latest).
+     */
+    void flush(std::vector<std::pair<git_oid, BloomFilter>> &pending) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending.empty() && !dirty)
+            return;
+
+        for(auto &p : pending) {
+            filters[p.first] = std::move(p.second);
+        }
+        pending.clear();
+        dirty = true;
+
+        int fd = lockFile();
+        if (fd < 0)
+            return;
+
+        // Keep what other processes saved since we loaded the file
+        readFile();
+        if (commitFile(fd))
+            dirty = false;
+    }
+
+    /**
+     * Create the lock file exclusively, removing it first if it is stale
+     *
+     * @return The descriptor of the lock file to write the new index into, or -1
+     */
+    int lockFile() {
+        mkdir(dir_path.c_str(), 0755);
+
+        auto lock_path = file_path + ".lock";
+        int fd = open(lock_path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+        if (fd < 0 && errno == EEXIST) {
+            struct stat st;
+            if (stat(lock_path.c_str(), &st) == 0 && time(NULL) - st.st_mtime > STALE_LOCK_AGE) {
+                unlink(lock_path.c_str());
+                fd = open(lock_path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+            }
+        }
+
+        return fd;
+    }
+
+    /**
+     * Write all filters into the lock file and rename it over the index. Must be called
+     * with mutex held.
+     */
+    bool commitFile(int fd) {
+        auto lock_path = file_path + ".lock";
+
+        FILE *f = fdopen(fd, "wb");
+        if (f == NULL) {
+            close(fd);
+            unlink(lock_path.c_str());
+            return false;
+        }
+
+        bool ok = writeHeader(f);
+        for(auto iter = filters.begin(); ok && iter != filters.end(); ++iter) {
+            ok = writeEntry(f, iter->first, iter->second);
+        }
+        ok = (fclose(f) == 0) && ok;
+
+        if (!ok || rename(lock_path.c_str(), file_path.c_str()) != 0) {
+            unlink(lock_path.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    // Must be called with mutex held
+    void ensureLoaded() {
+        if (loaded)
+            return;
+        loaded = true;
+
+        readFile();
+    }
+
+    /**
+     * Add the entries of the index file that are not in memory yet. Must be called with
+     * mutex held.
+     */
+    void readFile() {
+        FILE *f = fopen(file_path.c_str(), "rb");
+        if (f == NULL)
+            return;
+
+        char magic[4];
+        uint32_t version;
+        if (fread(magic, 1, 4, f) == 4 && memcmp(magic, "XGCP", 4) == 0 &&
+            readUInt32(f, version) && version == VERSION) {
+            // Stop at the first truncated entry (e.g. from an index written by an older version)
+            git_oid oid;
+            uint8_t too_large;
+            uint32_t size;
+            while (fread(oid.id, 1, GIT_OID_RAWSZ, f) == GIT_OID_RAWSZ &&
+                   fread(&too_large, 1, 1, f) == 1 &&
+                   readUInt32(f, size)) {
+                BloomFilter filter;
+                filter.tooLarge = (too_large != 0);
+                filter.bits.resize(size);
+                if (size > 0 && fread(filter.bits.data(), 1, size, f) != size)
+                    break;
+                filters.emplace(oid, std::move(filter));
+            }
+        }
+
+        fclose(f);
+    }
+
+    static bool writeHeader(FILE *f) {
+        return fwrite("XGCP", 1, 4, f) == 4 && writeUInt32(f, VERSION);
+    }
+
+    static bool writeEntry(FILE *f, const git_oid &oid, const BloomFilter &filter) {
+        uint8_t too_large = filter.tooLarge ? 1 : 0;
+        uint32_t size = (uint32_t)filter.bits.size();
+
+        return fwrite(oid.id, 1, GIT_OID_RAWSZ, f) == GIT_OID_RAWSZ &&
+               fwrite(&too_large, 1, 1, f) == 1 &&
+               writeUInt32(f, size) &&
+               (size == 0 || fwrite(filter.bits.data(), 1, size, f) == size);
+    }
+
+    // Integers are stored little-endian regardless of the host
+    static bool writeUInt32(FILE *f, uint32_t value) {
+        uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+        return fwrite(bytes, 1, 4, f) == 4;
+    }
+
+    static bool readUInt32(FILE *f, uint32_t &value) {
+        uint8_t bytes[4];
+        if (fread(bytes, 1, 4, f) != 4)
+            return false;
+        value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+        return true;
+    }
+
+    /**
+     * Compute the changed-paths filter of a commit against its first parent
+     * (or against the empty tree for a root commit).
+     */
+    static bool computeFilter(git_repository *repo, const git_oid &commit_oid, BloomFilter &result) {
+        git_commit *commit = NULL, *parent = NULL;
+        git_tree *tree = NULL, *parent_tree = NULL;
+        git_diff *diff = NULL;
+        bool ok = false;
+
+        if (git_commit_lookup(&commit, repo, &commit_oid) == 0 &&
+            git_commit_tree(&tree, commit) == 0 &&
+            (git_commit_parentcount(commit) == 0 ||
+             (git_commit_parent(&parent, commit, 0) == 0 && git_commit_tree(&parent_tree, parent) == 0))) {
+
+            // Tree-to-tree diff only compares OIDs so no blob is ever loaded
+            git_diff_options diff_opts;
+            git_diff_options_init(&diff_opts, GIT_DIFF_OPTIONS_VERSION);
+            diff_opts.flags |= GIT_DIFF_SKIP_BINARY_CHECK;
+
+            if (git_diff_tree_to_tree(&diff, repo, parent_tree, tree, &diff_opts) == 0) {
+                std::set<std::string> paths;
+                size_t num_deltas = git_diff_num_deltas(diff);
+                for(size_t i = 0; i < num_deltas && paths.size() <= BloomFilter::MAX_CHANGED_PATHS; i++) {
+                    auto delta = git_diff_get_delta(diff, i);
+                    addPathAndParents(paths, delta->old_file.path);
+                    addPathAndParents(paths, delta->new_file.path);
+                }
+
+                result = BloomFilter(paths);
+                ok = true;
+            }
+        }
+
+        git_diff_free(diff);
+        git_tree_free(parent_tree);
+        git_tree_free(tree);
+        git_commit_free(parent);
+        git_commit_free(commit);
+
+        return ok;
+    }
+
+    static void addPathAndParents(std::set<std::string> &paths, const char *path) {
+        if (path == NULL)
+            return;
+
+        std::string p(path);
+        paths.insert(p);
+        for(auto slash = p.rfind('/'); slash != std::string::npos && slash > 0; slash = p.rfind('/', slash - 1)) {
+            paths.insert(p.substr(0, slash));
+        }
+    }
+};
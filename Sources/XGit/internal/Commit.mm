@@ -6,7 +6,7 @@
 //
 
 #include "OID.mm"
-#include "Signature.mm"
+#include "StringInterner.mm"
 
 @implementation Commit
 {
@@ -20,7 +20,7 @@
     return self;
 }
 
-- (void)setLibGit2Commit:(git_commit* _Nonnull)commit :(const git_oid* _Nonnull)commit_oid
+- (void)setLibGit2Commit:(git_commit* _Nonnull)commit :(const git_oid* _Nonnull)commit_oid :(StringInterner&)interner
 {
     self->commit = commit;
 
@@ -35,9 +35,7 @@
     double time = static_cast<double>(git_commit_time(commit));
     self->_time = [[NSDate alloc] initWithTimeIntervalSince1970 :time];
 
-    git_signature* author = NULL;
-    git_signature_dup(&author, git_commit_author(commit));
-    self->_author = [[Signature alloc] init :author];
+    self->_author = interner.intern(git_commit_author(commit));
 
     self->computedParents = false;
 }
@@ -5,6 +5,7 @@
 //  Created by Lightech on 10/24/2048.
 //
 
+#import "StringInterner.mm"
 #import "DiffLine.mm"
 #import "DiffFile.mm"
 #import "DiffHunk.mm"
@@ -12,27 +13,17 @@
 #import "DiffCollector.mm"
 
 @implementation Diff
-{
-    git_diff *diff;
-}
-
-- (void)dealloc
-{
-    git_diff_free(diff);
-}
 
 - (nonnull instancetype)init
 {
-    self->diff = NULL;
     self->_deltas = [[NSMutableArray alloc] init];
 
     return self;
 }
 
-- (nonnull instancetype)init:(git_diff* _Nonnull)diff
+- (nonnull instancetype)initWithRecord:(const DiffRecord&)record :(StringInterner&)interner
 {
-    self->diff = diff;
-    self->_deltas = DiffCollector(diff).getDeltas();
+    self->_deltas = DiffCollector(record, interner).getDeltas();
 
     return self;
 }
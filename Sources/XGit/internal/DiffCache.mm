@@ -0,0 +1,260 @@
+//
+//  DiffCache.mm
+//  Cache of tree-to-tree diff results keyed by the pair of tree OIDs and the diff options
+//
+//  Trees are immutable so an entry never goes stale. Diffs are kept as DiffRecord, the
+//  same structured content (with full OIDs, sizes and modes) that a Diff is built from,
+//  so a hit returns exactly what a miss computes. There is a bounded in-memory LRU tier
+//  and an optional on-disk tier in `.git/xgit/diff-cache`, bounded by size and count.
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <map>
+#include <memory>
+#include <string>
+#include <cstdio>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#import "LRUCache.mm"
+#import "DiffRecord.mm"
+
+struct DiffCacheKey {
+    git_oid old_tree;
+    git_oid new_tree;
+    uint64_t options;
+};
+
+struct DiffCacheKeyCompare {
+    bool operator()(const DiffCacheKey &lhs, const DiffCacheKey &rhs) const {
+        int c = git_oid_cmp(&lhs.old_tree, &rhs.old_tree);
+        if (c != 0)
+            return c < 0;
+
+        c = git_oid_cmp(&lhs.new_tree, &rhs.new_tree);
+        if (c != 0)
+            return c < 0;
+
+        return lhs.options < rhs.options;
+    }
+};
+
+typedef std::shared_ptr<const DiffRecord> DiffRecordPtr;
+
+struct DiffCache {
+
+    // Budget of the on-disk tier
+    static const uint64_t MAX_DISK_SIZE = 64 * 1024 * 1024;
+    static const size_t MAX_DISK_ENTRIES = 4096;
+
+    DiffCache() {
+        memory.setCapacity(DEFAULT_MEMORY_LIMIT);
+    }
+
+    /**
+     * @param memory_limit Maximum total size in bytes of the diffs kept in memory
+     * @param disk_dir Directory of the on-disk tier or empty string to disable it
+     */
+    void configure(size_t memory_limit, const std::string &disk_dir) {
+        memory.setCapacity(memory_limit);
+        this->disk_dir = disk_dir;
+        disk_scanned = false;
+    }
+
+    /**
+     * @return The cached diff or NULL
+     */
+    DiffRecordPtr get(const DiffCacheKey &key) {
+        auto cached = memory.get(key);
+        if (cached != NULL)
+            return *cached;
+
+        std::string data;
+        if (disk_dir.empty() || !readFile(filePath(key), data))
+            return nullptr;
+
+        auto record = std::make_shared<DiffRecord>();
+        if (!record->deserialize(data))
+            return nullptr;
+
+        // Promote to the memory tier
+        memory.put(key, record, record->cost());
+
+        return record;
+    }
+
+    void put(const DiffCacheKey &key, const DiffRecordPtr &record) {
+        if (!disk_dir.empty()) {
+            std::string data;
+            record->serialize(data);
+
+            // A huge diff would evict many others for a single entry
+            if (data.size() <= MAX_DISK_SIZE / 16)
+                writeFile(filePath(key), data);
+        }
+
+        memory.put(key, record, record->cost());
+    }
+
+    /**
+     * Fingerprint of the diff options that affect the result
+     *
+     * @param extra Fingerprint of other options applied on the diff, such as rename detection
+     */
+    static uint64_t fingerprint(const git_diff_options &opts, uint64_t extra) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        auto mix = [&h](uint64_t value) {
+            h ^= value;
+            h *= 0x100000001b3ULL;
+        };
+
+        mix(opts.flags);
+        mix(opts.context_lines);
+        mix(opts.interhunk_lines);
+        mix((uint64_t)opts.max_size);
+        mix(extra);
+
+        return h;
+    }
+
+    /**
+     * OID of the empty tree, to be used as the base for diffing root commits
+     */
+    static git_oid emptyTreeId() {
+        git_oid oid;
+        git_oid_fromstr(&oid, "4b825dc642cb6eb9a060e54bf8d69288fbee4904");
+
+        return oid;
+    }
+
+    /**
+     * Remove the least recently written diffs of an on-disk cache directory until it
+     * holds at most `max_size` bytes in at most `max_entries` files. Readers are not
+     * affected: a removed diff is a miss.
+     *
+     * @return Number of bytes removed
+     */
+    static uint64_t trimDirectory(const std::string &dir, uint64_t max_size, size_t max_entries) {
+        // Diff files by modification time
+        std::multimap<time_t, std::pair<std::string, uint64_t>> files;
+        uint64_t total = scanDirectory(dir, &files);
+
+        uint64_t removed = 0;
+        size_t count = files.size();
+        for(auto iter = files.begin(); iter != files.end() && (total - removed > max_size || count > max_entries); ++iter) {
+            if (remove(iter->second.first.c_str()) == 0) {
+                removed += iter->second.second;
+                count--;
+            }
+        }
+
+        return removed;
+    }
+
+private:
+    static const size_t DEFAULT_MEMORY_LIMIT = 32 * 1024 * 1024;
+
+    LRUCache<DiffCacheKey, DiffRecordPtr, DiffCacheKeyCompare> memory;
+    std::string disk_dir;
+
+    // Usage of the on-disk tier, counted on the first write
+    bool disk_scanned = false;
+    uint64_t disk_size = 0;
+    size_t disk_entries = 0;
+
+    /**
+     * @return Total size of the diff files of the directory, which are added to `files`
+     *         by modification time if not NULL
+     */
+    static uint64_t scanDirectory(const std::string &dir, std::multimap<time_t, std::pair<std::string, uint64_t>> *files, size_t *count = NULL) {
+        DIR *d = opendir(dir.c_str());
+        if (d == NULL)
+            return 0;
+
+        uint64_t total = 0;
+        while (auto entry = readdir(d)) {
+            std::string name = entry->d_name;
+            if (name.size() < 5 || name.compare(name.size() - 5, 5, ".diff") != 0)
+                continue;
+
+            auto path = dir + "/" + name;
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0)
+                continue;
+
+            if (files != NULL)
+                files->insert(std::make_pair(st.st_mtime, std::make_pair(path, (uint64_t)st.st_size)));
+            if (count != NULL)
+                (*count)++;
+            total += st.st_size;
+        }
+        closedir(d);
+
+        return total;
+    }
+
+    std::string filePath(const DiffCacheKey &key) {
+        char old_str[GIT_OID_HEXSZ + 1], new_str[GIT_OID_HEXSZ + 1];
+        git_oid_tostr(old_str, sizeof(old_str), &key.old_tree);
+        git_oid_tostr(new_str, sizeof(new_str), &key.new_tree);
+
+        char options_str[17];
+        snprintf(options_str, sizeof(options_str), "%016llx", (unsigned long long)key.options);
+
+        return disk_dir + "/" + old_str + "-" + new_str + "-" + options_str + ".diff";
+    }
+
+    static bool readFile(const std::string &path, std::string &content) {
+        FILE *f = fopen(path.c_str(), "rb");
+        if (f == NULL)
+            return false;
+
+        struct stat st;
+        bool ok = (fstat(fileno(f), &st) == 0);
+        if (ok) {
+            content.resize(st.st_size);
+            ok = (st.st_size == 0 || fread(&content[0], 1, st.st_size, f) == (size_t)st.st_size);
+        }
+        fclose(f);
+
+        return ok;
+    }
+
+    void writeFile(const std::string &path, const std::string &content) {
+        // The parent `xgit` directory might not exist yet
+        auto parent_dir = disk_dir.substr(0, disk_dir.rfind('/'));
+        mkdir(parent_dir.c_str(), 0755);
+        mkdir(disk_dir.c_str(), 0755);
+
+        if (!disk_scanned) {
+            disk_entries = 0;
+            disk_size = scanDirectory(disk_dir, NULL, &disk_entries);
+            disk_scanned = true;
+        }
+
+        // Make room, down to 3/4 of the budget so that trimming is not needed on every write
+        if (disk_size + content.size() > MAX_DISK_SIZE || disk_entries + 1 > MAX_DISK_ENTRIES) {
+            trimDirectory(disk_dir, MAX_DISK_SIZE / 4 * 3, MAX_DISK_ENTRIES / 4 * 3);
+            disk_entries = 0;
+            disk_size = scanDirectory(disk_dir, NULL, &disk_entries);
+        }
+
+        // Write to a temporary file first so that readers never see a partial diff
+        auto temp_path = path + ".lock";
+        FILE *f = fopen(temp_path.c_str(), "wb");
+        if (f == NULL)
+            return;
+
+        bool ok = (content.empty() || fwrite(content.data(), 1, content.size(), f) == content.size());
+        ok = (fclose(f) == 0) && ok;
+
+        if (!ok || rename(temp_path.c_str(), path.c_str()) != 0) {
+            remove(temp_path.c_str());
+            return;
+        }
+
+        disk_size += content.size();
+        disk_entries++;
+    }
+};
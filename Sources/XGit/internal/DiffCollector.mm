@@ -1,107 +1,54 @@
 //
 //  DiffCollector.mm
-//  Helper struct to convert from libgit2's git_diff to Objective-C's Diff
+//  Helper struct to convert from libgit2's git_diff (through a DiffRecord) to Objective-C's Diff
 //
 //  Created by Lightech on 10/24/2048.
 //
 
-#include <list>
+#import "DiffRecord.mm"
 
 struct DiffCollector {
-    DiffCollector(git_diff * _Nonnull diff) {
-        git_diff_foreach(diff,
-            collect_diff_file,
-            collect_diff_binary_file,
-            collect_diff_hunk,
-            collect_diff_line,
-            this
-        );
+    DiffCollector(const DiffRecord &record, StringInterner &interner):
+        record(record), interner(interner) {
     }
 
     NSMutableArray<DiffDelta*>* _Nonnull getDeltas() {
-        return convertListToNSMutableArray<Delta,DiffDelta>(deltas);
-    }
-
-private:
-    template<typename S, typename T>
-    static NSMutableArray<T*>* _Nonnull convertListToNSMutableArray(std::list<S> &items) {
-        auto result = [[NSMutableArray alloc] init];
-        for(auto &item : items) {
-            [result addObject :(T*)item.get()];
+        auto result = [[NSMutableArray alloc] initWithCapacity:record.deltas.size()];
+        for(const auto &d : record.deltas) {
+            git_diff_delta delta;
+            record.getDelta(d, delta);
+
+            auto hunks = [[NSMutableArray alloc] initWithCapacity:d.num_hunks];
+            for(uint32_t i = 0; i < d.num_hunks; i++) {
+                [hunks addObject :getHunk(record.hunks[d.first_hunk + i])];
+            }
+
+            DiffDelta *result_delta = [[DiffDelta alloc] init :&delta :interner];
+            [result_delta setHunks :hunks];
+            [result addObject :result_delta];
         }
 
         return result;
     }
 
-    struct Hunk {
-        git_diff_hunk * _Nonnull hunk;
-        NSMutableArray<DiffLine*> * _Nonnull lines;
-
-        Hunk(git_diff_hunk * _Nonnull hunk) {
-            this->hunk = hunk;
-            this->lines = [[NSMutableArray alloc] init];
-        }
-
-        void addLine(const git_diff_line * _Nonnull line) {
-            [lines addObject :[[DiffLine alloc] init :line]];
-        }
-
-        DiffHunk * _Nonnull get() {
-            auto result = [[DiffHunk alloc] init :hunk];
-            [result setLines :lines];
-
-            return result;
-        }
-    };
-
-    struct Delta {
-        std::list<Hunk> hunks;
-        git_diff_delta * _Nonnull delta;
-
-        Delta(git_diff_delta * _Nonnull delta) {
-            this->delta = delta;
-        }
-
-        void addHunk(const git_diff_hunk * _Nonnull hunk) {
-            hunks.push_back(Hunk(const_cast<git_diff_hunk*>(hunk)));
-        }
-
-        DiffDelta * _Nonnull get() {
-            auto result = [[DiffDelta alloc] init :delta];
-            [result setHunks :convertListToNSMutableArray<Hunk,DiffHunk>(hunks)];
-
-            return result;
+private:
+    const DiffRecord &record;
+    StringInterner &interner;
+
+    DiffHunk * _Nonnull getHunk(const DiffRecord::Hunk &h) {
+        git_diff_hunk hunk;
+        record.getHunk(h, hunk);
+
+        auto lines = [[NSMutableArray alloc] initWithCapacity:h.num_lines];
+        for(uint32_t i = 0; i < h.num_lines; i++) {
+            git_diff_line line;
+            record.getLine(record.lines[h.first_line + i], line);
+            [lines addObject :[[DiffLine alloc] init :&line]];
         }
-    };
-    
-    std::list<Delta> deltas;
-
-    void addDelta(const git_diff_delta * _Nonnull delta) {
-        deltas.push_back(Delta(const_cast<git_diff_delta *>(delta)));
-    }
-
-    static int collect_diff_file(const git_diff_delta * _Nonnull delta, float progress, void * _Nonnull payload) {
-        DiffCollector *state = (DiffCollector*)payload;
-        state->addDelta(delta);
-
-        return 0;
-    }
-
-    static int collect_diff_binary_file(const git_diff_delta * _Nonnull delta, const git_diff_binary * _Nonnull binary, void * _Nonnull payload) {
-        return 0;
-    }
 
-    static int collect_diff_hunk(const git_diff_delta * _Nonnull delta, const git_diff_hunk * _Nonnull hunk, void * _Nonnull payload) {
-        DiffCollector *state = (DiffCollector*)payload;
-        state->deltas.back().addHunk(const_cast<git_diff_hunk*>(hunk));
+        DiffHunk *result = [[DiffHunk alloc] init :&hunk];
+        [result setLines :lines];
 
-        return 0;
-    }
-
-    static int collect_diff_line(const git_diff_delta * _Nonnull delta, const git_diff_hunk * _Nonnull hunk, const git_diff_line * _Nonnull line, void * _Nonnull payload) {
-        DiffCollector *state = (DiffCollector*)payload;
-        state->deltas.back().hunks.back().addLine(line);
-
-        return 0;
+        return result;
     }
 };
@@ -9,11 +9,15 @@
 {
 }
 
-- (nonnull instancetype)init:(const git_diff_delta* _Nonnull)delta
+- (nonnull instancetype)init:(const git_diff_delta* _Nonnull)delta :(StringInterner&)interner
 {
     self->_id = [[NSUUID alloc] init];
-    self->_theOldFile = [[DiffFile alloc] init :delta->old_file];
-    self->_theNewFile = [[DiffFile alloc] init :delta->new_file];
+    self->_theOldFile = [[DiffFile alloc] init :delta->old_file :interner];
+    self->_theNewFile = [[DiffFile alloc] init :delta->new_file :interner];
+
+    char status = git_diff_status_char(delta->status);
+    self->_status = NSStringFromBuffer(&status, 1);
+    self->_similarity = delta->similarity;
 
     return self;
 }
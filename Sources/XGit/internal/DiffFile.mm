@@ -9,9 +9,9 @@
 {
 }
 
-- (nonnull instancetype)init:(const git_diff_file&)file
+- (nonnull instancetype)init:(const git_diff_file&)file :(StringInterner&)interner
 {
-    self->_path = NSStringFromCString(file.path);
+    self->_path = interner.intern(file.path);
 
     return self;
 }
@@ -0,0 +1,35 @@
+//
+//  DiffFileStat.mm
+//  Implementation of Objective-C class DiffFileStat
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+/** Line counts of a file as computed by DiffStatHandler */
+struct FileStat {
+    size_t insertions = 0;
+    size_t deletions = 0;
+    bool binary = false;
+    bool too_large = false;
+    uint64_t old_size = 0;
+    uint64_t new_size = 0;
+};
+
+@implementation DiffFileStat
+{
+}
+
+- (nonnull instancetype)init:(const git_diff_delta* _Nonnull)delta :(const FileStat&)stat :(StringInterner&)interner
+{
+    self->_path = interner.intern(delta->new_file.path != NULL ? delta->new_file.path : delta->old_file.path);
+    self->_insertions = stat.insertions;
+    self->_deletions = stat.deletions;
+    self->_isBinary = stat.binary;
+    self->_isTooLarge = stat.too_large;
+    self->_oldSize = stat.old_size;
+    self->_newSize = stat.new_size;
+
+    return self;
+}
+
+@end
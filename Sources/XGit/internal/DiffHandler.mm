@@ -6,10 +6,13 @@
 //
 
 #import "DiffReceiverProtocol.h"
+#import "DiffCache.mm"
+#import "SimilarityDetector.mm"
 
 struct DiffHandler {
 
-    DiffHandler(id<DiffReceiverProtocol> diffReceiver) {
+    DiffHandler(id<DiffReceiverProtocol> diffReceiver, DiffCache &cache, const RenameOptions &rename_options, StringInterner &interner):
+        cache(cache), rename_options(rename_options), interner(interner) {
         this->diffReceiver = diffReceiver;
     }
 
@@ -21,18 +24,53 @@ struct DiffHandler {
     git_tree *old_tree = NULL;
     git_tree *new_tree = NULL;
     id<DiffReceiverProtocol> diffReceiver;
+    DiffCache &cache;
+    const RenameOptions &rename_options;
+    StringInterner &interner;
 
+    /**
+     * Diff two commits. A NULL `from_commit` means the empty tree so that root
+     * commits can be diffed.
+     */
     void diff(git_repository *repo, git_commit *from_commit, git_commit *to_commit) {
-        git_diff *diff;
-
-        git_commit_tree(&old_tree, from_commit);
-        git_commit_tree(&new_tree, to_commit);
+        git_diff *diff = NULL;
 
         git_diff_options diff_opts;
         git_diff_options_init(&diff_opts, GIT_DIFF_OPTIONS_VERSION);
-        git_diff_tree_to_tree(&diff, repo, old_tree, new_tree, &diff_opts);
 
-        Diff* result = [[Diff alloc] init :diff];
+        DiffCacheKey key {
+            (from_commit != NULL) ? *git_commit_tree_id(from_commit) : DiffCache::emptyTreeId(),
+            *git_commit_tree_id(to_commit),
+            DiffCache::fingerprint(diff_opts, rename_options.fingerprint())
+        };
+
+        DiffRecordPtr record = cache.get(key);
+        if (record == nullptr) {
+            if (from_commit != NULL)
+                git_commit_tree(&old_tree, from_commit);
+            git_commit_tree(&new_tree, to_commit);
+
+            if (git_diff_tree_to_tree(&diff, repo, old_tree, new_tree, &diff_opts) != 0)
+                return;
+
+            // Best effort: on failure the changes are reported as deletes and adds
+            SimilarityDetector detector(rename_options);
+            detector.detect(diff, diff_opts, [&](git_diff **out, const git_diff_options &opts) {
+                return git_diff_tree_to_tree(out, repo, old_tree, new_tree, &opts);
+            });
+
+            // The patches are generated once, for both the cache and the result
+            auto collected = std::make_shared<DiffRecord>();
+            int error = detector.collect(*collected);
+            git_diff_free(diff);
+            if (error != 0)
+                return;
+
+            record = collected;
+            cache.put(key, record);
+        }
+
+        Diff* result = [[Diff alloc] initWithRecord :*record :interner];
         [diffReceiver setChanges :result];
     }
 };
@@ -5,8 +5,11 @@
 //  Created by Lightech on 10/24/2048.
 //
 
+#import "IntraLineDiff.mm"
+
 @implementation DiffHunk
 {
+    NSArray<NSData*> *_intraLineChanges;
 }
 
 - (nonnull instancetype)init:(const git_diff_hunk* _Nonnull)hunk
@@ -23,4 +26,32 @@
     self->_lines = lines;
 }
 
+- (nonnull NSArray<NSData*>*)intraLineChanges
+{
+    @synchronized(self) {
+        if (_intraLineChanges != nil)
+            return _intraLineChanges;
+
+        std::vector<IntraLineDiff::Line> lines;
+        lines.reserve(_lines.count);
+        for(DiffLine *line in _lines) {
+            lines.push_back(IntraLineDiff::Line {
+                (char)[line.kind characterAtIndex:0],
+                [line.text UTF8String],
+                [line.text lengthOfBytesUsingEncoding:NSUTF8StringEncoding]
+            });
+        }
+
+        auto ranges = IntraLineDiff::compute(lines);
+
+        auto result = [[NSMutableArray alloc] initWithCapacity:ranges.size()];
+        for(auto &line_ranges : ranges) {
+            [result addObject :[NSData dataWithBytes:line_ranges.data() length:line_ranges.size() * sizeof(uint32_t)]];
+        }
+        _intraLineChanges = result;
+
+        return _intraLineChanges;
+    }
+}
+
 @end
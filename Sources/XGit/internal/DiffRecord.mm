@@ -0,0 +1,304 @@
+//
+//  DiffRecord.mm
+//  Compact and serializable copy of the content of a git_diff (deltas, hunks and lines)
+//
+//  Everything a Diff is made of is kept in a few flat arrays of fixed-size records plus a
+//  single text buffer holding the paths, hunk headers and line contents, so a record is
+//  cheap to keep in memory and to write to or read from disk. The Diff objects built from
+//  a record are the same as those built from the git_diff it was collected from.
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+struct DiffRecord {
+
+    /** Bytes [offset, offset + size) of the text buffer */
+    struct Span {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    struct File {
+        git_oid id;
+        uint64_t size;
+        uint32_t flags;
+        uint16_t mode;
+        uint16_t id_abbrev;
+        Span path; // NUL-terminated in the text buffer
+    };
+
+    struct Delta {
+        uint32_t status;
+        uint32_t flags;
+        uint16_t similarity;
+        uint16_t nfiles;
+        File old_file;
+        File new_file;
+        uint32_t first_hunk;
+        uint32_t num_hunks;
+    };
+
+    struct Hunk {
+        int32_t old_start;
+        int32_t old_lines;
+        int32_t new_start;
+        int32_t new_lines;
+        Span header;
+        uint32_t first_line;
+        uint32_t num_lines;
+    };
+
+    struct Line {
+        int32_t origin;
+        int32_t old_lineno;
+        int32_t new_lineno;
+        int32_t num_lines;
+        int64_t content_offset;
+        Span content;
+    };
+
+    std::vector<Delta> deltas;
+    std::vector<Hunk> hunks;
+    std::vector<Line> lines;
+    std::string text;
+
+    /**
+     * Collect the content of one delta of the diff, generating its patch once
+     */
+    int collect(git_diff *diff, size_t index) {
+        git_patch *patch = NULL;
+        int error = git_patch_from_diff(&patch, diff, index);
+        if (error != 0 || patch == NULL)
+            return error; // No patch for the deltas the diff options exclude
+
+        const git_diff_delta *delta = git_patch_get_delta(patch);
+        collect_file(delta, 0, this);
+
+        size_t num_hunks = git_patch_num_hunks(patch);
+        for(size_t i = 0; i < num_hunks && error == 0; i++) {
+            const git_diff_hunk *hunk;
+            size_t num_lines;
+            if ((error = git_patch_get_hunk(&hunk, &num_lines, patch, i)) != 0)
+                break;
+
+            collect_hunk(delta, hunk, this);
+            for(size_t j = 0; j < num_lines; j++) {
+                const git_diff_line *line;
+                if ((error = git_patch_get_line_in_hunk(&line, patch, i, j)) != 0)
+                    break;
+
+                collect_line(delta, hunk, line, this);
+            }
+        }
+        git_patch_free(patch);
+
+        return error;
+    }
+
+    /**
+     * Approximate memory used by the record
+     */
+    size_t cost() const {
+        return sizeof(DiffRecord) + deltas.size() * sizeof(Delta) + hunks.size() * sizeof(Hunk) +
+            lines.size() * sizeof(Line) + text.size();
+    }
+
+    /**
+     * Rebuild the libgit2 structures of the record, which point into the text buffer
+     */
+    void getDelta(const Delta &d, git_diff_delta &delta) const {
+        memset(&delta, 0, sizeof(delta));
+        delta.status = (git_delta_t)d.status;
+        delta.flags = d.flags;
+        delta.similarity = d.similarity;
+        delta.nfiles = d.nfiles;
+        getFile(d.old_file, delta.old_file);
+        getFile(d.new_file, delta.new_file);
+    }
+
+    void getHunk(const Hunk &h, git_diff_hunk &hunk) const {
+        memset(&hunk, 0, sizeof(hunk));
+        hunk.old_start = h.old_start;
+        hunk.old_lines = h.old_lines;
+        hunk.new_start = h.new_start;
+        hunk.new_lines = h.new_lines;
+        hunk.header_len = h.header.size;
+        memcpy(hunk.header, text.data() + h.header.offset, h.header.size);
+    }
+
+    void getLine(const Line &l, git_diff_line &line) const {
+        memset(&line, 0, sizeof(line));
+        line.origin = (char)l.origin;
+        line.old_lineno = l.old_lineno;
+        line.new_lineno = l.new_lineno;
+        line.num_lines = l.num_lines;
+        line.content_offset = l.content_offset;
+        line.content = text.data() + l.content.offset;
+        line.content_len = l.content.size;
+    }
+
+    /**
+     * Binary form for the on-disk cache. It is only ever read back on the same machine
+     * so the records are stored in the host's layout, which the header identifies.
+     */
+    void serialize(std::string &out) const {
+        uint32_t header[] = {
+            MAGIC, VERSION,
+            (uint32_t)sizeof(Delta), (uint32_t)sizeof(Hunk), (uint32_t)sizeof(Line),
+            (uint32_t)deltas.size(), (uint32_t)hunks.size(), (uint32_t)lines.size(), (uint32_t)text.size()
+        };
+
+        out.clear();
+        out.reserve(sizeof(header) + cost());
+        out.append((const char*)header, sizeof(header));
+        out.append((const char*)deltas.data(), deltas.size() * sizeof(Delta));
+        out.append((const char*)hunks.data(), hunks.size() * sizeof(Hunk));
+        out.append((const char*)lines.data(), lines.size() * sizeof(Line));
+        out.append(text);
+    }
+
+    /**
+     * @return Whether the data is a valid serialized record, e.g. not truncated or from
+     *         another version
+     */
+    bool deserialize(const std::string &data) {
+        uint32_t header[9];
+        if (data.size() < sizeof(header))
+            return false;
+        memcpy(header, data.data(), sizeof(header));
+
+        if (header[0] != MAGIC || header[1] != VERSION ||
+            header[2] != sizeof(Delta) || header[3] != sizeof(Hunk) || header[4] != sizeof(Line))
+            return false;
+
+        uint64_t expected = sizeof(header) + (uint64_t)header[5] * sizeof(Delta) +
+            (uint64_t)header[6] * sizeof(Hunk) + (uint64_t)header[7] * sizeof(Line) + header[8];
+        if (data.size() != expected)
+            return false;
+
+        const char *p = data.data() + sizeof(header);
+        deltas.resize(header[5]);
+        memcpy(deltas.data(), p, deltas.size() * sizeof(Delta));
+        p += deltas.size() * sizeof(Delta);
+        hunks.resize(header[6]);
+        memcpy(hunks.data(), p, hunks.size() * sizeof(Hunk));
+        p += hunks.size() * sizeof(Hunk);
+        lines.resize(header[7]);
+        memcpy(lines.data(), p, lines.size() * sizeof(Line));
+        p += lines.size() * sizeof(Line);
+        text.assign(p, header[8]);
+
+        return isConsistent();
+    }
+
+private:
+    static const uint32_t MAGIC = 0x46444758; // "XGDF"
+    static const uint32_t VERSION = 1;
+
+    void getFile(const File &f, git_diff_file &file) const {
+        file.id = f.id;
+        file.size = f.size;
+        file.flags = f.flags;
+        file.mode = f.mode;
+        file.id_abbrev = f.id_abbrev;
+        file.path = text.data() + f.path.offset;
+    }
+
+    Span addText(const char *data, size_t size, bool terminate) {
+        Span span { (uint32_t)text.size(), (uint32_t)size };
+        text.append(data, size);
+        if (terminate)
+            text.push_back('\0');
+
+        return span;
+    }
+
+    void addFile(const git_diff_file &file, File &f) {
+        f.id = file.id;
+        f.size = file.size;
+        f.flags = file.flags;
+        f.mode = file.mode;
+        f.id_abbrev = file.id_abbrev;
+        const char *path = (file.path != NULL) ? file.path : "";
+        f.path = addText(path, strlen(path), true);
+    }
+
+    bool validSpan(const Span &span, bool terminated) const {
+        return (uint64_t)span.offset + span.size + (terminated ? 1 : 0) <= text.size();
+    }
+
+    bool isConsistent() const {
+        for(const auto &d : deltas) {
+            if (!validSpan(d.old_file.path, true) || !validSpan(d.new_file.path, true) ||
+                (uint64_t)d.first_hunk + d.num_hunks > hunks.size())
+                return false;
+        }
+        for(const auto &h : hunks) {
+            if (!validSpan(h.header, false) || h.header.size > GIT_DIFF_HUNK_HEADER_SIZE ||
+                (uint64_t)h.first_line + h.num_lines > lines.size())
+                return false;
+        }
+        for(const auto &l : lines) {
+            if (!validSpan(l.content, false))
+                return false;
+        }
+
+        return true;
+    }
+
+    static int collect_file(const git_diff_delta *delta, float progress, void *payload) {
+        DiffRecord *record = (DiffRecord*)payload;
+
+        Delta d;
+        memset(&d, 0, sizeof(d));
+        d.status = delta->status;
+        d.flags = delta->flags;
+        d.similarity = delta->similarity;
+        d.nfiles = delta->nfiles;
+        record->addFile(delta->old_file, d.old_file);
+        record->addFile(delta->new_file, d.new_file);
+        d.first_hunk = (uint32_t)record->hunks.size();
+        record->deltas.push_back(d);
+
+        return 0;
+    }
+
+    static int collect_hunk(const git_diff_delta *delta, const git_diff_hunk *hunk, void *payload) {
+        DiffRecord *record = (DiffRecord*)payload;
+
+        Hunk h;
+        memset(&h, 0, sizeof(h));
+        h.old_start = hunk->old_start;
+        h.old_lines = hunk->old_lines;
+        h.new_start = hunk->new_start;
+        h.new_lines = hunk->new_lines;
+        h.header = record->addText(hunk->header, hunk->header_len, false);
+        h.first_line = (uint32_t)record->lines.size();
+        record->hunks.push_back(h);
+        record->deltas.back().num_hunks++;
+
+        return 0;
+    }
+
+    static int collect_line(const git_diff_delta *delta, const git_diff_hunk *hunk, const git_diff_line *line, void *payload) {
+        DiffRecord *record = (DiffRecord*)payload;
+
+        Line l;
+        memset(&l, 0, sizeof(l));
+        l.origin = line->origin;
+        l.old_lineno = line->old_lineno;
+        l.new_lineno = line->new_lineno;
+        l.num_lines = line->num_lines;
+        l.content_offset = line->content_offset;
+        l.content = record->addText(line->content, line->content_len, false);
+        record->lines.push_back(l);
+        record->hunks.back().num_lines++;
+
+        return 0;
+    }
+};
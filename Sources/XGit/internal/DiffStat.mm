@@ -0,0 +1,30 @@
+//
+//  DiffStat.mm
+//  Implementation of Objective-C class DiffStat
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#import "DiffFileStat.mm"
+
+@implementation DiffStat
+{
+}
+
+- (nonnull instancetype)init
+{
+    self->_files = [[NSArray alloc] init];
+
+    return self;
+}
+
+- (nonnull instancetype)init:(nonnull NSArray<DiffFileStat*> *)files :(NSUInteger)insertions :(NSUInteger)deletions
+{
+    self->_files = files;
+    self->_insertions = insertions;
+    self->_deletions = deletions;
+
+    return self;
+}
+
+@end
@@ -0,0 +1,402 @@
+//
+//  DiffStatHandler.mm
+//  Single-use struct to compute the diffstat (numbers of added/deleted lines per file)
+//  of commit-to-commit diffs and of the staged and unstaged changes
+//
+//  Unlike DiffCollector, no line is ever materialized: added and deleted files are
+//  counted with ByteScanner and modified files are diffed with a line counting callback.
+//  Like libgit2's diff, working directory files are compared after their filters (e.g.
+//  CRLF conversion) are applied and the `diff` attribute decides what is binary.
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#import "DiffStatReceiverProtocol.h"
+#import "DiffStat.mm"
+#import "ByteScanner.mm"
+#import "GitErrorReporter.mm"
+#import "SimilarityDetector.mm"
+
+struct DiffStatHandler: GitErrorReporter {
+
+    // Files larger than this are reported without line counts
+    static const uint64_t MAX_FILE_SIZE = 16 * 1024 * 1024;
+
+    DiffStatHandler(id<ErrorReceiverProtocol> errorReceiver, const RenameOptions &rename_options, StringInterner &interner):
+        GitErrorReporter(errorReceiver), rename_options(rename_options), interner(interner) {
+    }
+
+    ~DiffStatHandler() {
+        git_tree_free(old_tree);
+        git_tree_free(new_tree);
+        git_index_free(index);
+        git_reference_free(head_ref);
+        git_object_free(head_tree);
+        git_config_free(config);
+        git_odb_free(odb);
+    }
+
+    void diff(git_repository *repo, git_commit *from_commit, git_commit *to_commit, id<DiffStatReceiverProtocol> receiver) {
+        if (!openRepository(repo))
+            return;
+
+        if (from_commit != NULL && reportError(git_commit_tree(&old_tree, from_commit), "Diffstat: Cannot look up tree"))
+            return;
+
+        if (reportError(git_commit_tree(&new_tree, to_commit), "Diffstat: Cannot look up tree"))
+            return;
+
+        git_diff_options diff_opts;
+        git_diff_options_init(&diff_opts, GIT_DIFF_OPTIONS_VERSION);
+
+        git_diff *diff;
+        if (reportError(git_diff_tree_to_tree(&diff, repo, old_tree, new_tree, &diff_opts), "Diffstat: Error computing diff"))
+            return;
+
+        SimilarityDetector detector(rename_options);
+        detector.detect(diff, diff_opts, [&](git_diff **out, const git_diff_options &opts) {
+            return git_diff_tree_to_tree(out, repo, old_tree, new_tree, &opts);
+        });
+        [receiver setStat :computeStat(detector, NULL)];
+        git_diff_free(diff);
+    }
+
+    void status(git_repository *repo, id<DiffStatReceiverProtocol> stagedReceiver, id<DiffStatReceiverProtocol> unstagedReceiver) {
+        if (!openRepository(repo))
+            return;
+
+        if (reportError(git_repository_index(&index, repo), "Cannot open index"))
+            return;
+
+        git_diff_options diff_opts;
+        git_diff_options_init(&diff_opts, GIT_DIFF_OPTIONS_VERSION);
+        diff_opts.flags |= GIT_DIFF_INCLUDE_UNTRACKED | GIT_DIFF_RECURSE_UNTRACKED_DIRS;
+
+        git_diff *diff;
+        if (reportError(git_diff_index_to_workdir(&diff, repo, index, &diff_opts), "Error computing unstaged changes"))
+            return;
+
+        SimilarityDetector unstaged_detector(rename_options);
+        unstaged_detector.detect(diff, diff_opts, [&](git_diff **out, const git_diff_options &opts) {
+            return git_diff_index_to_workdir(out, repo, index, &opts);
+        });
+        [unstagedReceiver setStat :computeStat(unstaged_detector, git_repository_workdir(repo))];
+        git_diff_free(diff);
+
+        if (git_repository_head(&head_ref, repo) == 0) {
+            if (reportError(git_reference_peel(&head_tree, head_ref, GIT_OBJECT_TREE), "Warning: HEAD does not point to a commit tree! This repo might be corrupted!"))
+                return;
+        }
+
+        if (reportError(git_diff_tree_to_index(&diff, repo, (git_tree*)head_tree, index, &diff_opts), "Error computing staged changes"))
+            return;
+
+        SimilarityDetector staged_detector(rename_options);
+        staged_detector.detect(diff, diff_opts, [&](git_diff **out, const git_diff_options &opts) {
+            return git_diff_tree_to_index(out, repo, (git_tree*)head_tree, index, &opts);
+        });
+        [stagedReceiver setStat :computeStat(staged_detector, NULL)];
+        git_diff_free(diff);
+    }
+
+private:
+    const RenameOptions &rename_options;
+    StringInterner &interner;
+    git_repository *repo = NULL;
+    git_odb *odb = NULL;
+    git_config *config = NULL;
+    git_tree *old_tree = NULL;
+    git_tree *new_tree = NULL;
+    git_index *index = NULL;
+    git_reference *head_ref = NULL;
+    git_object *head_tree = NULL;
+
+    bool openRepository(git_repository *repo) {
+        this->repo = repo;
+        if (reportError(git_repository_odb(&odb, repo), "Diffstat: Cannot open object database"))
+            return false;
+
+        return !reportError(git_repository_config_snapshot(&config, repo), "Diffstat: Cannot read configuration");
+    }
+
+    /**
+     * Content of one side of a delta, either a blob or a file of the working directory,
+     * either mapped or filtered
+     */
+    struct Content {
+        ~Content() {
+            git_blob_free(blob);
+            if (mapped != NULL)
+                munmap(mapped, size);
+            git_buf_dispose(&filtered);
+        }
+
+        const char *data = NULL;
+        size_t size = 0;
+        bool exists = false;
+
+        git_oid blob_id;
+        git_blob *blob = NULL;
+
+        const char *workdir_path = NULL; // Relative to the working directory
+        void *mapped = NULL;
+        git_buf filtered = { NULL, 0, 0 };
+        std::string link_target;
+    };
+
+    /** Effect of the `diff` attribute of a file on the diffstat */
+    enum DiffDriver {
+        DRIVER_AUTO,    // Binary if the content looks binary
+        DRIVER_TEXT,    // `diff` is set: always text
+        DRIVER_BINARY   // `-diff` (e.g. from the `binary` macro) or a driver with `binary = true`
+    };
+
+    /**
+     * @param workdir Path to the working directory if the new side of the diff is the working directory
+     */
+    DiffStat *computeStat(const SimilarityDetector &detector, const char *workdir) {
+        NSMutableArray<DiffFileStat*> *files = [[NSMutableArray alloc] init];
+        size_t total_insertions = 0, total_deletions = 0;
+
+        for(const auto &ref : detector.deltas()) {
+            auto delta = ref.delta();
+            if (delta->status == GIT_DELTA_UNMODIFIED || delta->status == GIT_DELTA_IGNORED)
+                continue;
+
+            FileStat stat;
+            computeFileStat(delta, workdir, stat);
+            total_insertions += stat.insertions;
+            total_deletions += stat.deletions;
+
+            [files addObject :[[DiffFileStat alloc] init :delta :stat :interner]];
+        }
+
+        return [[DiffStat alloc] init :files :total_insertions :total_deletions];
+    }
+
+    void computeFileStat(const git_diff_delta *delta, const char *workdir, FileStat &stat) {
+        bool has_old = (delta->status != GIT_DELTA_ADDED && delta->status != GIT_DELTA_UNTRACKED);
+        bool has_new = (delta->status != GIT_DELTA_DELETED);
+
+        // Submodules have no content to count
+        if ((has_old && delta->old_file.mode == GIT_FILEMODE_COMMIT) ||
+            (has_new && delta->new_file.mode == GIT_FILEMODE_COMMIT))
+            return;
+
+        Content old_content, new_content;
+        if (has_old)
+            openBlob(delta->old_file, old_content, stat.old_size);
+        if (has_new) {
+            if (workdir != NULL)
+                openWorkdirFile(workdir, delta->new_file, new_content, stat.new_size);
+            else
+                openBlob(delta->new_file, new_content, stat.new_size);
+        }
+
+        DiffDriver driver = lookupDriver(has_new ? delta->new_file.path : delta->old_file.path);
+        if (driver == DRIVER_BINARY) {
+            stat.binary = true;
+            return;
+        }
+
+        if (stat.old_size > MAX_FILE_SIZE || stat.new_size > MAX_FILE_SIZE) {
+            stat.too_large = true;
+            return;
+        }
+
+        if (!loadContent(old_content) || !loadContent(new_content))
+            return;
+
+        if (driver == DRIVER_AUTO &&
+            ((old_content.exists && ByteScanner::isBinary(old_content.data, old_content.size)) ||
+             (new_content.exists && ByteScanner::isBinary(new_content.data, new_content.size)))) {
+            stat.binary = true;
+            return;
+        }
+
+        if (!old_content.exists) {
+            stat.insertions = ByteScanner::countLines(new_content.data, new_content.size);
+        } else if (!new_content.exists) {
+            stat.deletions = ByteScanner::countLines(old_content.data, old_content.size);
+        } else if (old_content.size != new_content.size ||
+                   memcmp(old_content.data, new_content.data, old_content.size) != 0) {
+            countChangedLines(old_content, new_content, delta->new_file.path, stat);
+        }
+    }
+
+    /** Only read the object header at first so that large blobs are never loaded */
+    void openBlob(const git_diff_file &file, Content &content, uint64_t &size) {
+        size_t length;
+        git_object_t type;
+        if (git_odb_read_header(&length, &type, odb, &file.id) != 0)
+            return;
+
+        content.exists = true;
+        content.blob_id = file.id;
+        size = length;
+    }
+
+    /**
+     * Same rules as libgit2's diff drivers, minus what does not change line counts
+     * (function context patterns)
+     */
+    DiffDriver lookupDriver(const char *path) {
+        const char *value = NULL;
+        if (git_attr_get(&value, repo, 0, path, "diff") != 0)
+            return DRIVER_AUTO;
+
+        switch (git_attr_value(value)) {
+            case GIT_ATTR_VALUE_TRUE:
+                return DRIVER_TEXT;
+
+            case GIT_ATTR_VALUE_FALSE:
+                return DRIVER_BINARY;
+
+            case GIT_ATTR_VALUE_STRING: {
+                int binary = 0;
+                std::string key = std::string("diff.") + value + ".binary";
+                if (git_config_get_bool(&binary, config, key.c_str()) == 0 && binary)
+                    return DRIVER_BINARY;
+
+                return DRIVER_AUTO;
+            }
+
+            default:
+                return DRIVER_AUTO;
+        }
+    }
+
+    bool loadContent(Content &content) {
+        if (!content.exists || content.data != NULL)
+            return true;
+
+        if (content.workdir_path != NULL)
+            return loadWorkdirFile(content);
+
+        if (git_blob_lookup(&content.blob, repo, &content.blob_id) != 0)
+            return false;
+
+        content.data = (const char*)git_blob_rawcontent(content.blob);
+        content.size = (size_t)git_blob_rawsize(content.blob);
+
+        return true;
+    }
+
+    /**
+     * Only look at the file's metadata at first so that large files are never read
+     */
+    void openWorkdirFile(const char *workdir, const git_diff_file &file, Content &content, uint64_t &size) {
+        std::string path = std::string(workdir) + file.path;
+
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0)
+            return;
+
+        if (S_ISLNK(st.st_mode)) {
+            // Git stores the target of a symbolic link as the content
+            content.link_target.resize(st.st_size);
+            auto length = readlink(path.c_str(), &content.link_target[0], content.link_target.size());
+            if (length < 0)
+                return;
+            content.link_target.resize(length);
+            content.data = content.link_target.data();
+            content.size = content.link_target.size();
+            content.exists = true;
+            size = content.size;
+            return;
+        }
+
+        if (!S_ISREG(st.st_mode))
+            return;
+
+        content.exists = true;
+        content.workdir_path = file.path;
+        size = st.st_size;
+    }
+
+    /**
+     * Read a working directory file as it would be stored in the object database: through
+     * the filters that apply to it, or mapped as is if there is none
+     */
+    bool loadWorkdirFile(Content &content) {
+        git_filter_list *filters = NULL;
+        if (git_filter_list_load(&filters, repo, NULL, content.workdir_path, GIT_FILTER_TO_ODB, GIT_FILTER_DEFAULT) != 0)
+            return false;
+
+        if (filters != NULL) {
+            int error = git_filter_list_apply_to_file(&content.filtered, filters, repo, content.workdir_path);
+            git_filter_list_free(filters);
+            if (error != 0)
+                return false;
+
+            content.data = (content.filtered.ptr != NULL) ? content.filtered.ptr : "";
+            content.size = content.filtered.size;
+            return true;
+        }
+
+        std::string path = std::string(git_repository_workdir(repo)) + content.workdir_path;
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+
+        if (st.st_size == 0) {
+            close(fd);
+            content.data = "";
+            return true;
+        }
+
+        void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (mapped == MAP_FAILED)
+            return false;
+
+        content.mapped = mapped;
+        content.data = (const char*)mapped;
+        content.size = st.st_size;
+
+        return true;
+    }
+
+    struct LineCounts {
+        size_t insertions = 0;
+        size_t deletions = 0;
+    };
+
+    static int count_line(const git_diff_delta *delta, const git_diff_hunk *hunk, const git_diff_line *line, void *payload) {
+        LineCounts *counts = (LineCounts*)payload;
+        if (line->origin == GIT_DIFF_LINE_ADDITION)
+            counts->insertions++;
+        else if (line->origin == GIT_DIFF_LINE_DELETION)
+            counts->deletions++;
+
+        return 0;
+    }
+
+    static void countChangedLines(const Content &old_content, const Content &new_content, const char *path, FileStat &stat) {
+        git_diff_options diff_opts;
+        git_diff_options_init(&diff_opts, GIT_DIFF_OPTIONS_VERSION);
+        diff_opts.context_lines = 0;
+        diff_opts.interhunk_lines = 0;
+        diff_opts.flags |= GIT_DIFF_FORCE_TEXT; // Binary content was already ruled out
+
+        LineCounts counts;
+        if (git_diff_buffers(old_content.data, old_content.size, path,
+                             new_content.data, new_content.size, path,
+                             &diff_opts, NULL, NULL, NULL, count_line, &counts) == 0) {
+            stat.insertions = counts.insertions;
+            stat.deletions = counts.deletions;
+        }
+    }
+};
@@ -0,0 +1,43 @@
+//
+//  ImportCommit.mm
+//  Implementation of Objective-C class ImportCommit
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <vector>
+
+/** One change of an ImportCommit, a nil content means removal */
+struct ImportChange {
+    NSString *path;
+    NSData *content;
+    bool executable;
+};
+
+@implementation ImportCommit
+{
+    @public std::vector<ImportChange> changes;
+}
+
+- (nonnull instancetype)init:(nonnull NSString*)refName :(nonnull NSString*)message :(nonnull NSString*)authorName :(nonnull NSString*)authorEmail :(nonnull NSDate*)time
+{
+    self->_refName = refName;
+    self->_message = message;
+    self->_authorName = authorName;
+    self->_authorEmail = authorEmail;
+    self->_time = time;
+
+    return self;
+}
+
+- (void)writeFile:(nonnull NSString*)path :(nonnull NSData*)content :(BOOL)executable
+{
+    changes.push_back(ImportChange { path, content, executable != NO });
+}
+
+- (void)removeFile:(nonnull NSString*)path
+{
+    changes.push_back(ImportChange { path, nil, false });
+}
+
+@end
@@ -0,0 +1,301 @@
+//
+//  ImportHandler.mm
+//  Single-use struct to create many commits at once without the index or working directory
+//
+//  Objects are written to an in-memory backend (mempack) of a private repository handle so
+//  that no loose object is ever written. Trees are built by applying each commit's changes to
+//  its parent tree. At the end, all new objects are stored as a single pack with its index and
+//  the references are updated together in one transaction.
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <map>
+#include <string>
+#include <vector>
+
+#import "git2/sys/mempack.h"
+
+#import "ImportCommit.mm"
+#import "GitErrorReporter.mm"
+
+struct ImportHandler: GitErrorReporter {
+
+    ImportHandler(id<ErrorReceiverProtocol> errorReceiver):
+        GitErrorReporter(errorReceiver) {
+    }
+
+    ~ImportHandler() {
+        git_transaction_free(transaction);
+        git_odb_free(odb); // The mempack backend is owned by the object database
+        git_repository_free(import_repo);
+    }
+
+    /**
+     * @return The OIDs of the created commits in order, or nil on error in which case
+     *         no reference is updated
+     */
+    NSArray<OID*>* _Nullable import(git_repository *repo, NSArray<ImportCommit*> *commits) {
+        if (commits.count == 0)
+            return @[];
+
+        if (reportError(git_repository_open(&import_repo, git_repository_path(repo)), "Import: Cannot open repository"))
+            return nil;
+
+        if (reportError(git_repository_odb(&odb, import_repo), "Import: Cannot open object database"))
+            return nil;
+
+        git_odb_backend *mempack = NULL;
+        if (reportError(git_mempack_new(&mempack), "Import: Cannot create in-memory object backend"))
+            return nil;
+
+        // Highest priority so that all new objects are written there
+        if (reportError(git_odb_add_backend(odb, mempack, MEMPACK_PRIORITY), "Import: Cannot add in-memory object backend")) {
+            mempack->free(mempack);
+            return nil;
+        }
+
+        auto result = [[NSMutableArray alloc] initWithCapacity:commits.count];
+        for(ImportCommit *commit in commits) {
+            git_oid commit_oid;
+            if (!importCommit(commit, commit_oid))
+                return nil;
+
+            [result addObject :[[OID alloc] init :&commit_oid]];
+        }
+
+        if (!writePack(mempack))
+            return nil;
+
+        if (!updateReferences(commits.count))
+            return nil;
+
+        return result;
+    }
+
+private:
+    static const int MEMPACK_PRIORITY = 1000;
+
+    git_repository *import_repo = NULL;
+    git_odb *odb = NULL;
+    git_transaction *transaction = NULL;
+
+    /** Current tip of each imported reference and its target before the import (zero if new) */
+    struct Tip {
+        git_oid original;
+        git_oid current;
+    };
+    std::map<std::string, Tip> tips;
+
+    /** Name of the reference updated for each reference name of the commits */
+    std::map<std::string, std::string> resolved_names;
+
+    bool importCommit(ImportCommit *commit, git_oid &commit_oid) {
+        std::string ref_name;
+        if (!resolveName([commit.refName UTF8String], ref_name))
+            return false;
+
+        auto iter = tips.find(ref_name);
+        if (iter == tips.end()) {
+            Tip tip;
+            int error = git_reference_name_to_id(&tip.original, import_repo, ref_name.c_str());
+            if (error == GIT_ENOTFOUND) {
+                memset(&tip.original, 0, sizeof(tip.original));
+            } else if (reportError(error, "Import: Cannot resolve reference")) {
+                return false;
+            }
+            tip.current = tip.original;
+            iter = tips.insert(std::make_pair(ref_name, tip)).first;
+        }
+
+        git_commit *parent = NULL;
+        git_tree *base_tree = NULL;
+        git_tree *tree = NULL;
+        git_signature *signature = NULL;
+
+        bool ok = buildCommit(commit, iter->second.current, parent, base_tree, tree, signature, commit_oid);
+        if (ok)
+            iter->second.current = commit_oid;
+
+        git_signature_free(signature);
+        git_tree_free(tree);
+        git_tree_free(base_tree);
+        git_commit_free(parent);
+
+        return ok;
+    }
+
+    /**
+     * Follow a symbolic reference such as HEAD to the branch it points to, which is the
+     * reference to update: writing the symbolic reference itself would detach it
+     */
+    bool resolveName(const std::string &name, std::string &resolved) {
+        auto iter = resolved_names.find(name);
+        if (iter != resolved_names.end()) {
+            resolved = iter->second;
+            return true;
+        }
+
+        git_reference *ref = NULL;
+        git_reference *target = NULL;
+        int error = git_reference_lookup(&ref, import_repo, name.c_str());
+        if (error == GIT_ENOTFOUND) {
+            resolved = name;
+            error = 0;
+        } else if (error == 0 && git_reference_type(ref) == GIT_REFERENCE_SYMBOLIC) {
+            error = git_reference_resolve(&target, ref);
+            if (error == 0) {
+                resolved = git_reference_name(target);
+            } else if (error == GIT_ENOTFOUND) {
+                // Unborn branch e.g. HEAD of a new repository
+                resolved = git_reference_symbolic_target(ref);
+                error = 0;
+            }
+        } else if (error == 0) {
+            resolved = name;
+        }
+        git_reference_free(target);
+        git_reference_free(ref);
+
+        if (reportError(error, "Import: Cannot resolve reference"))
+            return false;
+
+        resolved_names[name] = resolved;
+        return true;
+    }
+
+    bool buildCommit(ImportCommit *commit, const git_oid &parent_oid,
+                     git_commit *&parent, git_tree *&base_tree, git_tree *&tree, git_signature *&signature,
+                     git_oid &commit_oid) {
+        if (!git_oid_is_zero(&parent_oid)) {
+            if (reportError(git_commit_lookup(&parent, import_repo, &parent_oid), "Import: Cannot look up parent commit"))
+                return false;
+
+            if (reportError(git_commit_tree(&base_tree, parent), "Import: Cannot look up parent tree"))
+                return false;
+        }
+
+        // Only the last change of a path counts
+        std::map<std::string, const ImportChange*> changes;
+        for(const auto &change : commit->changes) {
+            changes[[change.path UTF8String]] = &change;
+        }
+
+        std::vector<git_tree_update> updates;
+        updates.reserve(changes.size());
+        for(const auto &p : changes) {
+            git_tree_update update;
+            memset(&update, 0, sizeof(update));
+            update.path = p.first.c_str();
+
+            NSData *content = p.second->content;
+            if (content != nil) {
+                if (reportError(git_blob_create_from_buffer(&update.id, import_repo, content.bytes, content.length), "Import: Cannot write file content"))
+                    return false;
+
+                update.action = GIT_TREE_UPDATE_UPSERT;
+                update.filemode = p.second->executable ? GIT_FILEMODE_BLOB_EXECUTABLE : GIT_FILEMODE_BLOB;
+            } else {
+                if (!hasEntry(base_tree, p.first))
+                    continue;
+
+                update.action = GIT_TREE_UPDATE_REMOVE;
+            }
+
+            updates.push_back(update);
+        }
+
+        git_oid tree_oid;
+        if (reportError(git_tree_create_updated(&tree_oid, import_repo, base_tree, updates.size(), updates.data()), "Import: Cannot build tree"))
+            return false;
+
+        if (reportError(git_tree_lookup(&tree, import_repo, &tree_oid), "Import: Cannot look up tree"))
+            return false;
+
+        NSDate *time = commit.time;
+        int offset = (int)([[NSTimeZone localTimeZone] secondsFromGMTForDate:time] / 60);
+        if (reportError(git_signature_new(&signature, [commit.authorName UTF8String], [commit.authorEmail UTF8String],
+                                          (git_time_t)time.timeIntervalSince1970, offset),
+                        "Import: Invalid author"))
+            return false;
+
+        const git_commit *parents[] = { parent };
+        return !reportError(git_commit_create(&commit_oid, import_repo, NULL, signature, signature, NULL,
+                                              [commit.message UTF8String], tree, parent != NULL ? 1 : 0, parents),
+                            "Import: Cannot create commit");
+    }
+
+    static bool hasEntry(git_tree *tree, const std::string &path) {
+        if (tree == NULL)
+            return false;
+
+        git_tree_entry *entry = NULL;
+        bool found = (git_tree_entry_bypath(&entry, tree, path.c_str()) == 0);
+        git_tree_entry_free(entry);
+
+        return found;
+    }
+
+    /**
+     * Store all objects of the mempack as one pack (and index) in the repository
+     */
+    bool writePack(git_odb_backend *mempack) {
+        git_buf pack = { NULL, 0, 0 };
+        if (reportError(git_mempack_dump(&pack, import_repo, mempack), "Import: Cannot create pack")) {
+            git_buf_dispose(&pack);
+            return false;
+        }
+
+        git_odb_writepack *writepack = NULL;
+        int error = git_odb_write_pack(&writepack, odb, NULL, NULL);
+        if (error == 0) {
+            git_indexer_progress stats;
+            memset(&stats, 0, sizeof(stats));
+            error = writepack->append(writepack, pack.ptr, pack.size, &stats);
+            if (error == 0)
+                error = writepack->commit(writepack, &stats);
+            writepack->free(writepack);
+        }
+        git_buf_dispose(&pack);
+
+        return !reportError(error, "Import: Cannot write pack");
+    }
+
+    /**
+     * Move all references in one transaction, failing if any of them changed during the import
+     */
+    bool updateReferences(size_t num_commits) {
+        if (reportError(git_transaction_new(&transaction, import_repo), "Import: Cannot start reference transaction"))
+            return false;
+
+        for(const auto &p : tips) {
+            if (reportError(git_transaction_lock_ref(transaction, p.first.c_str()), "Import: Cannot lock reference"))
+                return false;
+        }
+
+        for(const auto &p : tips) {
+            git_oid target;
+            int error = git_reference_name_to_id(&target, import_repo, p.first.c_str());
+            if (error == GIT_ENOTFOUND) {
+                memset(&target, 0, sizeof(target));
+            } else if (reportError(error, "Import: Cannot resolve reference")) {
+                return false;
+            }
+
+            if (!git_oid_equal(&target, &p.second.original)) {
+                git_error_clear();
+                reportError(GIT_EMODIFIED, "Import: Reference was updated during the import");
+                return false;
+            }
+        }
+
+        std::string message = "import: " + std::to_string(num_commits) + " commit(s)";
+        for(const auto &p : tips) {
+            if (reportError(git_transaction_set_target(transaction, p.first.c_str(), &p.second.current, NULL, message.c_str()),
+                            "Import: Cannot update reference"))
+                return false;
+        }
+
+        return !reportError(git_transaction_commit(transaction), "Import: Cannot update references");
+    }
+};
@@ -0,0 +1,23 @@
+//
+//  InternStatistics.mm
+//  Implementation of Objective-C class InternStatistics
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+@implementation InternStatistics
+{
+}
+
+- (nonnull instancetype)init:(size_t)count :(size_t)bytes :(size_t)lookups :(size_t)hits
+{
+    self->_count = count;
+    self->_bytes = bytes;
+    self->_lookups = lookups;
+    self->_hits = hits;
+    self->_hitRate = (lookups > 0) ? (double)hits / lookups : 0;
+
+    return self;
+}
+
+@end
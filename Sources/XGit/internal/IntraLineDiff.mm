@@ -0,0 +1,213 @@
+//
+//  IntraLineDiff.mm
+//  Word-level diff of the removed and added lines of a hunk to find the changed byte ranges
+//
+//  Each run of removed lines is paired line by line with the run of added lines that follows
+//  it. Paired lines are split into tokens (words, white space runs, single punctuation) and
+//  the tokens are matched with a longest common subsequence. The LCS table is bounded so that
+//  pathological lines degrade to the ranges left after trimming the common prefix and suffix.
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#import "ByteScanner.mm"
+
+struct IntraLineDiff {
+
+    struct Line {
+        char kind;
+        const char *data;
+        size_t size;
+    };
+
+    /**
+     * Flat list of (offset, length) pairs of the changed bytes of a line
+     */
+    typedef std::vector<uint32_t> Ranges;
+
+    /**
+     * @return The changed ranges of each line, empty for context and unpaired lines
+     */
+    static std::vector<Ranges> compute(const std::vector<Line> &lines) {
+        std::vector<Ranges> result(lines.size());
+
+        size_t i = 0;
+        while (i < lines.size()) {
+            if (lines[i].kind != '-') {
+                i++;
+                continue;
+            }
+
+            size_t removed_start = i;
+            for(; i < lines.size() && lines[i].kind == '-'; i++);
+            size_t added_start = i;
+            for(; i < lines.size() && lines[i].kind == '+'; i++);
+
+            size_t num_removed = added_start - removed_start;
+            size_t num_added = i - added_start;
+            size_t num_pairs = (num_removed < num_added) ? num_removed : num_added;
+            for(size_t p = 0; p < num_pairs; p++) {
+                diffLines(lines[removed_start + p], lines[added_start + p], result[removed_start + p], result[added_start + p]);
+            }
+        }
+
+        return result;
+    }
+
+private:
+    // Lines longer than this are only trimmed by their common prefix and suffix
+    static const size_t MAX_LINE_SIZE = 4096;
+
+    // Maximum number of cells of the LCS table for one pair of lines
+    static const size_t MAX_LCS_CELLS = 64 * 1024;
+
+    struct Token {
+        uint32_t offset;
+        uint32_t size;
+        uint32_t hash;
+    };
+
+    static void tokenize(const Line &line, std::vector<Token> &tokens) {
+        const char *data = line.data;
+        size_t size = line.size;
+
+        size_t i = 0;
+        while (i < size) {
+            size_t end;
+            if (ByteScanner::isWordByte(data[i]))
+                end = ByteScanner::skipWord(data, size, i);
+            else if (ByteScanner::isSpaceByte(data[i]))
+                end = ByteScanner::skipSpace(data, size, i);
+            else
+                end = i + 1;
+
+            uint32_t hash = 2166136261u;
+            for(size_t j = i; j < end; j++) {
+                hash = (hash ^ (uint8_t)data[j]) * 16777619u;
+            }
+
+            tokens.push_back(Token { (uint32_t)i, (uint32_t)(end - i), hash });
+            i = end;
+        }
+    }
+
+    static bool sameToken(const Line &a, const Token &ta, const Line &b, const Token &tb) {
+        return ta.hash == tb.hash && ta.size == tb.size && memcmp(a.data + ta.offset, b.data + tb.offset, ta.size) == 0;
+    }
+
+    static void diffLines(const Line &removed, const Line &added, Ranges &removed_ranges, Ranges &added_ranges) {
+        if (removed.size > MAX_LINE_SIZE || added.size > MAX_LINE_SIZE) {
+            trimCommonBytes(removed, added, removed_ranges, added_ranges);
+            return;
+        }
+
+        std::vector<Token> a, b;
+        tokenize(removed, a);
+        tokenize(added, b);
+
+        size_t prefix = 0;
+        while (prefix < a.size() && prefix < b.size() && sameToken(removed, a[prefix], added, b[prefix]))
+            prefix++;
+
+        size_t suffix = 0;
+        while (suffix < a.size() - prefix && suffix < b.size() - prefix &&
+               sameToken(removed, a[a.size() - 1 - suffix], added, b[b.size() - 1 - suffix]))
+            suffix++;
+
+        size_t n = a.size() - prefix - suffix;
+        size_t m = b.size() - prefix - suffix;
+
+        // Whether each token of the middle part is changed. The middle part of a line can
+        // be empty and start at the end of its tokens, hence the pointer arithmetic.
+        std::vector<bool> a_changed(n, true), b_changed(m, true);
+        if (n > 0 && m > 0 && n * m <= MAX_LCS_CELLS)
+            matchTokens(removed, a.data() + prefix, n, added, b.data() + prefix, m, a_changed, b_changed);
+
+        collectRanges(a.data() + prefix, a_changed, removed_ranges);
+        collectRanges(b.data() + prefix, b_changed, added_ranges);
+    }
+
+    /**
+     * Standard LCS dynamic programming over tokens, marking the matched tokens as unchanged
+     */
+    static void matchTokens(const Line &removed, const Token *a, size_t n,
+                            const Line &added, const Token *b, size_t m,
+                            std::vector<bool> &a_changed, std::vector<bool> &b_changed) {
+        // lcs[i * (m + 1) + j] is the LCS length of a[i..] and b[j..]. It never exceeds
+        // min(n, m) which is at most sqrt(MAX_LCS_CELLS) so 16 bits are enough.
+        std::vector<uint16_t> lcs((n + 1) * (m + 1), 0);
+        for(size_t i = n; i-- > 0;) {
+            for(size_t j = m; j-- > 0;) {
+                uint16_t &cell = lcs[i * (m + 1) + j];
+                if (sameToken(removed, a[i], added, b[j])) {
+                    cell = lcs[(i + 1) * (m + 1) + j + 1] + 1;
+                } else {
+                    uint16_t down = lcs[(i + 1) * (m + 1) + j];
+                    uint16_t right = lcs[i * (m + 1) + j + 1];
+                    cell = (down > right) ? down : right;
+                }
+            }
+        }
+
+        size_t i = 0, j = 0;
+        while (i < n && j < m) {
+            if (sameToken(removed, a[i], added, b[j])) {
+                a_changed[i++] = false;
+                b_changed[j++] = false;
+            } else if (lcs[(i + 1) * (m + 1) + j] >= lcs[i * (m + 1) + j + 1]) {
+                i++;
+            } else {
+                j++;
+            }
+        }
+    }
+
+    static void collectRanges(const Token *tokens, const std::vector<bool> &changed, Ranges &ranges) {
+        for(size_t i = 0; i < changed.size(); i++) {
+            if (!changed[i])
+                continue;
+
+            // Merge with the previous range if adjacent
+            if (!ranges.empty() && ranges[ranges.size() - 2] + ranges.back() == tokens[i].offset) {
+                ranges.back() += tokens[i].size;
+            } else {
+                ranges.push_back(tokens[i].offset);
+                ranges.push_back(tokens[i].size);
+            }
+        }
+    }
+
+    static void trimCommonBytes(const Line &removed, const Line &added, Ranges &removed_ranges, Ranges &added_ranges) {
+        size_t shorter = (removed.size < added.size) ? removed.size : added.size;
+
+        size_t prefix = 0;
+        while (prefix < shorter && removed.data[prefix] == added.data[prefix])
+            prefix++;
+
+        size_t suffix = 0;
+        while (suffix < shorter - prefix && removed.data[removed.size - 1 - suffix] == added.data[added.size - 1 - suffix])
+            suffix++;
+
+        // Do not split a UTF-8 sequence: continuation bytes are 10xxxxxx
+        auto continuation = [](const Line &line, size_t i) {
+            return i < line.size && ((uint8_t)line.data[i] & 0xC0) == 0x80;
+        };
+        while (prefix > 0 && (continuation(removed, prefix) || continuation(added, prefix)))
+            prefix--;
+        while (suffix > 0 && continuation(removed, removed.size - suffix))
+            suffix--;
+
+        if (removed.size > prefix + suffix) {
+            removed_ranges.push_back((uint32_t)prefix);
+            removed_ranges.push_back((uint32_t)(removed.size - prefix - suffix));
+        }
+        if (added.size > prefix + suffix) {
+            added_ranges.push_back((uint32_t)prefix);
+            added_ranges.push_back((uint32_t)(added.size - prefix - suffix));
+        }
+    }
+};
@@ -0,0 +1,93 @@
+//
+//  LRUCache.mm
+//  Generic least-recently-used cache bounded by the total cost of its entries
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <list>
+
+template<typename K, typename V, typename Compare = std::less<K>>
+struct LRUCache {
+
+    LRUCache(size_t capacity = 0) {
+        this->capacity = capacity;
+    }
+
+    /**
+     * Look up an entry and mark it as most recently used
+     *
+     * @return pointer to the cached value, valid until the next modification of the cache,
+     *         or NULL if there is no such entry
+     */
+    V *get(const K &key) {
+        auto iter = index.find(key);
+        if (iter == index.end())
+            return NULL;
+
+        entries.splice(entries.begin(), entries, iter->second);
+
+        return &(iter->second->value);
+    }
+
+    /**
+     * Insert or replace an entry, evicting the least recently used ones as needed.
+     * Entries that cost more than the whole capacity are not cached at all.
+     */
+    void put(const K &key, V value, size_t cost) {
+        remove(key);
+
+        if (cost > capacity)
+            return;
+
+        entries.push_front(Entry { key, std::move(value), cost });
+        index[key] = entries.begin();
+        total_cost += cost;
+
+        evict();
+    }
+
+    void remove(const K &key) {
+        auto iter = index.find(key);
+        if (iter == index.end())
+            return;
+
+        total_cost -= iter->second->cost;
+        entries.erase(iter->second);
+        index.erase(iter);
+    }
+
+    void setCapacity(size_t capacity) {
+        this->capacity = capacity;
+        evict();
+    }
+
+    size_t count() const {
+        return entries.size();
+    }
+
+    size_t cost() const {
+        return total_cost;
+    }
+
+private:
+    struct Entry {
+        K key;
+        V value;
+        size_t cost;
+    };
+
+    std::list<Entry> entries; // Most recently used first
+    std::map<K, typename std::list<Entry>::iterator, Compare> index;
+    size_t capacity;
+    size_t total_cost = 0;
+
+    void evict() {
+        while (total_cost > capacity && !entries.empty()) {
+            auto &last = entries.back();
+            total_cost -= last.cost;
+            index.erase(last.key);
+            entries.pop_back();
+        }
+    }
+};
@@ -0,0 +1,459 @@
+//
+//  MaintenanceHandler.mm
+//  Single-use struct to keep the object database and our auxiliary indexes compact
+//
+//  Loose objects and the objects of small packs are written into one new pack with
+//  git_packbuilder. Only once that pack and its index are in place, the small packs and
+//  the loose objects found in it are deleted, so a concurrent reader always finds every
+//  object (libgit2 rescans the packs when an object is missing). Large and .keep packs are
+//  left as is, and loose objects they already hold are deleted without being packed again.
+//  Nothing is ever dropped from the object database: unreachable objects are packed too.
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#import "git2/sys/odb_backend.h"
+
+#import "MaintenanceResult.mm"
+#import "GitErrorReporter.mm"
+#import "ChangedPathsIndex.mm"
+#import "DiffCache.mm"
+
+struct MaintenanceHandler: GitErrorReporter {
+
+    struct Result {
+        size_t objects_packed = 0;
+        size_t loose_objects_removed = 0;
+        size_t packs_removed = 0;
+        int64_t bytes_reclaimed = 0;
+    };
+
+    MaintenanceHandler(id<ErrorReceiverProtocol> errorReceiver):
+        GitErrorReporter(errorReceiver) {
+    }
+
+    ~MaintenanceHandler() {
+        git_packbuilder_free(packbuilder);
+        git_odb_free(kept_odb);
+        git_repository_free(maintenance_repo);
+        if (lock_fd >= 0)
+            close(lock_fd); // Releases the lock
+    }
+
+    /**
+     * Cheap check, like `git gc --auto`, of whether there are enough loose objects or
+     * packs to make maintenance worthwhile
+     */
+    static bool isDue(git_repository *repo) {
+        std::string objects_dir = std::string(git_repository_path(repo)) + "objects";
+
+        // Objects are evenly spread by their hash so one fan-out directory is a good sample
+        if (listDirectory(objects_dir + "/17").size() * 256 > AUTO_LOOSE_LIMIT)
+            return true;
+
+        std::vector<PackFile> packs;
+        listPacks(objects_dir + "/pack", packs);
+
+        // Like gc.autoPackLimit, only the packs that would be consolidated count
+        return std::count_if(packs.begin(), packs.end(), isConsolidated) > (ptrdiff_t)AUTO_PACK_LIMIT;
+    }
+
+    /**
+     * @param changed_paths Index of changed paths to compact, can be NULL
+     */
+    bool maintain(git_repository *repo, ChangedPathsIndex *changed_paths, Result &result) {
+        std::string git_dir = git_repository_path(repo);
+        std::string objects_dir = git_dir + "objects";
+        std::string pack_dir = objects_dir + "/pack";
+
+        if (!acquireLock(git_dir))
+            return false;
+
+        // Use a separate handle so that the caller's handle is not blocked
+        if (reportError(git_repository_open(&maintenance_repo, git_dir.c_str()), "Maintenance: Cannot open repository"))
+            return false;
+
+        std::vector<PackFile> packs, small_packs, kept_packs;
+        listPacks(pack_dir, packs);
+        for(const auto &pack : packs) {
+            (isConsolidated(pack) ? small_packs : kept_packs).push_back(pack);
+        }
+
+        if (!openKeptPacks(kept_packs))
+            return false;
+
+        // Loose objects that a kept pack already holds are only deleted
+        std::vector<LooseObject> all_loose_objects, loose_objects, kept_objects;
+        listLooseObjects(objects_dir, all_loose_objects);
+        for(const auto &object : all_loose_objects) {
+            (isKept(object.oid) ? kept_objects : loose_objects).push_back(object);
+        }
+        removeLooseObjects(kept_objects, result);
+
+        // A single small pack without loose objects is already as compact as it gets
+        if (loose_objects.empty() && small_packs.size() <= 1) {
+            removeEmptyFanOutDirectories(objects_dir);
+            return compactIndexes(git_dir, changed_paths, result);
+        }
+
+        std::set<git_oid, OIDCompare> objects;
+        for(const auto &object : loose_objects) {
+            objects.insert(object.oid);
+        }
+        for(const auto &pack : small_packs) {
+            std::vector<git_oid> pack_objects;
+            if (!readPackIndex(pack.base_path + ".idx", pack_objects)) {
+                git_error_clear();
+                reportError(GIT_ERROR, "Maintenance: Cannot read pack index");
+                return false;
+            }
+            std::copy_if(pack_objects.begin(), pack_objects.end(), std::inserter(objects, objects.end()), [this](const git_oid &oid) {
+                return !isKept(oid);
+            });
+        }
+
+        // Nothing to write if the kept packs hold every object
+        std::string new_pack;
+        std::vector<git_oid> packed_list;
+        if (!objects.empty()) {
+            if (!writePack(pack_dir, objects, new_pack))
+                return false;
+            result.objects_packed = objects.size();
+
+            // Confirm what the new pack holds before deleting anything
+            if (!readPackIndex(new_pack + ".idx", packed_list)) {
+                git_error_clear();
+                reportError(GIT_ERROR, "Maintenance: Cannot read the new pack index");
+                return false;
+            }
+            result.bytes_reclaimed -= fileSize(new_pack + ".pack") + fileSize(new_pack + ".idx");
+        }
+        std::set<git_oid, OIDCompare> packed(packed_list.begin(), packed_list.end());
+
+        for(const auto &pack : small_packs) {
+            if (pack.base_path == new_pack)
+                continue;
+
+            std::vector<git_oid> pack_objects;
+            bool all_packed = readPackIndex(pack.base_path + ".idx", pack_objects);
+            for(const auto &oid : pack_objects) {
+                all_packed = all_packed && (packed.count(oid) > 0 || isKept(oid));
+            }
+            if (!all_packed)
+                continue;
+
+            // The multi-pack index would still list the removed packs, so it goes first
+            if (result.packs_removed == 0)
+                unlink((pack_dir + "/multi-pack-index").c_str());
+
+            result.bytes_reclaimed += removePack(pack.base_path);
+            result.packs_removed++;
+        }
+
+        loose_objects.erase(std::remove_if(loose_objects.begin(), loose_objects.end(), [&packed](const LooseObject &object) {
+            return packed.count(object.oid) == 0;
+        }), loose_objects.end());
+        removeLooseObjects(loose_objects, result);
+        removeEmptyFanOutDirectories(objects_dir);
+
+        return compactIndexes(git_dir, changed_paths, result);
+    }
+
+private:
+    // Same defaults as git's gc.auto and gc.autoPackLimit
+    static const size_t AUTO_LOOSE_LIMIT = 6700;
+    static const size_t AUTO_PACK_LIMIT = 50;
+
+    // Packs from fetches are usually small; the one from a clone is big and kept as is
+    static const uint64_t SMALL_PACK_SIZE = 32 * 1024 * 1024;
+
+    git_repository *maintenance_repo = NULL;
+    git_packbuilder *packbuilder = NULL;
+    int lock_fd = -1;
+
+    // Object database of the packs that are not consolidated
+    git_odb *kept_odb = NULL;
+
+    struct LooseObject {
+        git_oid oid;
+        std::string path;
+        uint64_t size;
+    };
+
+    struct PackFile {
+        std::string base_path; // Without the .pack/.idx extension
+        uint64_t size;
+        bool keep;
+    };
+
+    /**
+     * Only one maintenance at a time, including across processes. The lock is held on the
+     * open file so however long the maintenance takes, it never looks stale, and the system
+     * releases it if the process dies.
+     */
+    bool acquireLock(const std::string &git_dir) {
+        std::string xgit_dir = git_dir + "xgit";
+        mkdir(xgit_dir.c_str(), 0755);
+        std::string path = xgit_dir + "/maintenance.lock";
+
+        lock_fd = open(path.c_str(), O_CREAT | O_RDWR, 0644);
+        if (lock_fd < 0) {
+            git_error_clear();
+            reportError(GIT_ERROR, "Maintenance: Cannot open the lock file");
+            return false;
+        }
+
+        if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+            git_error_clear();
+            reportError(GIT_ELOCKED, "Maintenance: Another maintenance is running");
+            return false;
+        }
+
+        return true;
+    }
+
+    static bool isConsolidated(const PackFile &pack) {
+        return !pack.keep && pack.size < SMALL_PACK_SIZE;
+    }
+
+    bool openKeptPacks(const std::vector<PackFile> &packs) {
+        if (reportError(git_odb_new(&kept_odb), "Maintenance: Cannot create object database"))
+            return false;
+
+        for(const auto &pack : packs) {
+            git_odb_backend *backend = NULL;
+            if (reportError(git_odb_backend_one_pack(&backend, (pack.base_path + ".idx").c_str()), "Maintenance: Cannot open pack"))
+                return false;
+
+            // The backend is owned by the object database once added
+            if (reportError(git_odb_add_backend(kept_odb, backend, 1), "Maintenance: Cannot open pack")) {
+                backend->free(backend);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool isKept(const git_oid &oid) {
+        return git_odb_exists(kept_odb, &oid) != 0;
+    }
+
+    static void removeLooseObjects(const std::vector<LooseObject> &objects, Result &result) {
+        for(const auto &object : objects) {
+            if (unlink(object.path.c_str()) == 0) {
+                result.bytes_reclaimed += object.size;
+                result.loose_objects_removed++;
+            }
+        }
+    }
+
+    bool writePack(const std::string &pack_dir, const std::set<git_oid, OIDCompare> &objects, std::string &new_pack) {
+        if (reportError(git_packbuilder_new(&packbuilder, maintenance_repo), "Maintenance: Cannot create pack builder"))
+            return false;
+
+        // Use as many threads as there are cores
+        git_packbuilder_set_threads(packbuilder, 0);
+
+        for(const auto &oid : objects) {
+            if (reportError(git_packbuilder_insert(packbuilder, &oid, NULL), "Maintenance: Cannot add object to pack"))
+                return false;
+        }
+
+        if (reportError(git_packbuilder_write(packbuilder, pack_dir.c_str(), 0, NULL, NULL), "Maintenance: Cannot write pack"))
+            return false;
+
+        char hash[GIT_OID_HEXSZ + 1];
+        git_oid_tostr(hash, sizeof(hash), git_packbuilder_hash(packbuilder));
+        new_pack = pack_dir + "/pack-" + hash;
+
+        return true;
+    }
+
+    bool compactIndexes(const std::string &git_dir, ChangedPathsIndex *changed_paths, Result &result) {
+        if (changed_paths != NULL) {
+            result.bytes_reclaimed += changed_paths->rewrite(maintenance_repo);
+            changed_paths->update(maintenance_repo);
+        }
+
+        result.bytes_reclaimed += DiffCache::trimDirectory(git_dir + "xgit/diff-cache", DiffCache::MAX_DISK_SIZE, DiffCache::MAX_DISK_ENTRIES);
+
+        return true;
+    }
+
+    static std::vector<std::string> listDirectory(const std::string &path) {
+        std::vector<std::string> names;
+
+        DIR *d = opendir(path.c_str());
+        if (d == NULL)
+            return names;
+
+        while (auto entry = readdir(d)) {
+            if (entry->d_name[0] != '.')
+                names.push_back(entry->d_name);
+        }
+        closedir(d);
+
+        return names;
+    }
+
+    static uint64_t fileSize(const std::string &path) {
+        struct stat st;
+        return (stat(path.c_str(), &st) == 0) ? st.st_size : 0;
+    }
+
+    static bool isHex(const std::string &s, size_t length) {
+        if (s.size() != length)
+            return false;
+
+        for(char c : s) {
+            if (!isxdigit((unsigned char)c))
+                return false;
+        }
+
+        return true;
+    }
+
+    static void listLooseObjects(const std::string &objects_dir, std::vector<LooseObject> &objects) {
+        for(const auto &fan_out : listDirectory(objects_dir)) {
+            if (!isHex(fan_out, 2))
+                continue;
+
+            auto dir = objects_dir + "/" + fan_out;
+            for(const auto &name : listDirectory(dir)) {
+                // Skip temporary files of objects being written
+                if (!isHex(name, GIT_OID_HEXSZ - 2))
+                    continue;
+
+                LooseObject object;
+                if (git_oid_fromstr(&object.oid, (fan_out + name).c_str()) != 0)
+                    continue;
+                object.path = dir + "/" + name;
+                object.size = fileSize(object.path);
+                objects.push_back(object);
+            }
+        }
+    }
+
+    static void removeEmptyFanOutDirectories(const std::string &objects_dir) {
+        for(const auto &fan_out : listDirectory(objects_dir)) {
+            if (isHex(fan_out, 2))
+                rmdir((objects_dir + "/" + fan_out).c_str()); // Fails if not empty
+        }
+    }
+
+    /**
+     * Packs with both a .pack and an .idx file, i.e. completely written
+     */
+    static void listPacks(const std::string &pack_dir, std::vector<PackFile> &packs) {
+        auto names = listDirectory(pack_dir);
+        std::set<std::string> files(names.begin(), names.end());
+
+        for(const auto &name : names) {
+            if (name.size() <= 5 || name.compare(name.size() - 5, 5, ".pack") != 0)
+                continue;
+
+            auto base_name = name.substr(0, name.size() - 5);
+            if (files.count(base_name + ".idx") == 0)
+                continue;
+
+            PackFile pack;
+            pack.base_path = pack_dir + "/" + base_name;
+            pack.size = fileSize(pack.base_path + ".pack");
+            pack.keep = files.count(base_name + ".keep") > 0 || files.count(base_name + ".promisor") > 0;
+            packs.push_back(pack);
+        }
+    }
+
+    /**
+     * Remove a pack, index first so that new readers no longer see it
+     *
+     * @return Number of bytes removed
+     */
+    static uint64_t removePack(const std::string &base_path) {
+        uint64_t removed = 0;
+        for(const char *ext : { ".idx", ".pack", ".rev", ".bitmap" }) {
+            auto path = base_path + ext;
+            auto size = fileSize(path);
+            if (unlink(path.c_str()) == 0)
+                removed += size;
+        }
+
+        return removed;
+    }
+
+    /**
+     * Read the object IDs of a pack index, version 1 or 2
+     */
+    static bool readPackIndex(const std::string &path, std::vector<git_oid> &oids) {
+        FILE *f = fopen(path.c_str(), "rb");
+        if (f == NULL)
+            return false;
+
+        bool ok = false;
+        uint32_t header[2];
+        if (fread(header, 4, 2, f) == 2) {
+            bool v2 = (readBigEndian(header[0]) == 0xff744f63);
+            if (v2 && readBigEndian(header[1]) != 2) {
+                fclose(f);
+                return false;
+            }
+
+            // The last entry of the fan-out table is the number of objects
+            long fan_out_start = v2 ? 8 : 0;
+            uint32_t count;
+            if (fseek(f, fan_out_start + 255 * 4, SEEK_SET) == 0 && fread(&count, 4, 1, f) == 1) {
+                count = readBigEndian(count);
+                ok = isValidIndexSize(fileSize(path), v2, count);
+                if (ok)
+                    oids.resize(count);
+
+                if (v2) {
+                    // Sorted table of object names right after the fan-out table
+                    for(uint32_t i = 0; ok && i < count; i++) {
+                        ok = fread(oids[i].id, 1, GIT_OID_RAWSZ, f) == GIT_OID_RAWSZ;
+                    }
+                } else {
+                    // Entries of 4-byte offset followed by the object name
+                    for(uint32_t i = 0; ok && i < count; i++) {
+                        uint32_t offset;
+                        ok = fread(&offset, 4, 1, f) == 1 && fread(oids[i].id, 1, GIT_OID_RAWSZ, f) == GIT_OID_RAWSZ;
+                    }
+                }
+            }
+        }
+        fclose(f);
+
+        return ok;
+    }
+
+    /**
+     * Whether a pack index of that size can hold `count` objects, so that a corrupt count
+     * is not trusted to allocate the object IDs
+     */
+    static bool isValidIndexSize(uint64_t size, bool v2, uint32_t count) {
+        // v2: header, fan-out table then a name, a CRC and an offset per object
+        // v1: fan-out table then an offset and a name per object
+        uint64_t min_size = v2 ? 8 + 256 * 4 + (uint64_t)count * (GIT_OID_RAWSZ + 4 + 4)
+                               : 256 * 4 + (uint64_t)count * (4 + GIT_OID_RAWSZ);
+
+        return size >= min_size;
+    }
+
+    static uint32_t readBigEndian(uint32_t value) {
+        const uint8_t *bytes = (const uint8_t*)&value;
+        return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+    }
+};
@@ -0,0 +1,22 @@
+//
+//  MaintenanceResult.mm
+//  Implementation of Objective-C class MaintenanceResult
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+@implementation MaintenanceResult
+{
+}
+
+- (nonnull instancetype)init:(NSUInteger)objectsPacked :(NSUInteger)looseObjectsRemoved :(NSUInteger)packsRemoved :(int64_t)bytesReclaimed
+{
+    self->_objectsPacked = objectsPacked;
+    self->_looseObjectsRemoved = looseObjectsRemoved;
+    self->_packsRemoved = packsRemoved;
+    self->_bytesReclaimed = bytesReclaimed;
+
+    return self;
+}
+
+@end
@@ -0,0 +1,260 @@
+//
+//  MultiFetchHandler.mm
+//  Single-use struct to fetch several remotes concurrently (git fetch --multiple)
+//
+//  The fetch of each remote is split in two like git_remote_fetch does:
+//   1. The download (negotiation and pack transfer) runs on a pool of worker threads, each
+//      remote with its own repository handle since a handle must not be shared by threads.
+//   2. Once every download finished, the remote-tracking references of all remotes are updated
+//      in one sequential phase on the calling thread, in the order of the remotes, so that no
+//      reference is written while another remote is still downloading.
+//  Progress of the downloads is summed up over the remotes before being reported.
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#import "RemoteProgressReporter.mm"
+#import "GitErrorReporter.mm"
+
+struct MultiFetchHandler: GitErrorReporter {
+
+    MultiFetchHandler(id<RemoteProgressProtocol> remoteProgress, id<ErrorReceiverProtocol> errorReceiver):
+        GitErrorReporter(errorReceiver),
+        remoteProgress(remoteProgress) {
+    }
+
+    ~MultiFetchHandler() {
+        for(auto &job : jobs) {
+            git_remote_free(job.remote);
+            git_repository_free(job.repo);
+        }
+    }
+
+    /**
+     * Fetch the remotes with at most `parallelism` downloads at a time (a default limit if 0)
+     *
+     * @param remote_names The remotes to fetch, or NULL for all configured remotes
+     */
+    void fetch(git_repository *repo, const std::vector<std::string> *remote_names, size_t parallelism) {
+        if (!prepareJobs(repo, remote_names)) {
+            [remoteProgress onComplete];
+            return;
+        }
+
+        if (parallelism == 0)
+            parallelism = DEFAULT_PARALLELISM;
+        if (parallelism > jobs.size())
+            parallelism = jobs.size();
+
+        repo_path = git_repository_path(repo);
+
+        std::vector<std::thread> workers;
+        workers.reserve(parallelism);
+        for(size_t i = 0; i < parallelism; i++) {
+            workers.emplace_back([this]() {
+                for(size_t j = next_job++; j < jobs.size(); j = next_job++) {
+                    download(jobs[j]);
+                }
+            });
+        }
+        for(auto &worker : workers) {
+            worker.join();
+        }
+
+        updateTips();
+
+        [remoteProgress onComplete];
+    }
+
+private:
+    static const size_t DEFAULT_PARALLELISM = 4;
+
+    struct Job {
+        MultiFetchHandler *handler;
+        std::string name;
+
+        // Private handle of the worker, kept until the update phase which needs the
+        // references advertised by the remote
+        git_repository *repo = NULL;
+        git_remote *remote = NULL;
+
+        // Latest download progress of this remote
+        git_indexer_progress stats;
+
+        // Errors are thread-local in libgit2 so they are copied to be reported later
+        int error = 0;
+        int error_class = 0;
+        std::string error_message;
+    };
+
+    id<RemoteProgressProtocol> remoteProgress;
+    std::string repo_path;
+
+    std::vector<Job> jobs;
+    std::atomic<size_t> next_job { 0 };
+
+    // Serializes the calls to remoteProgress from the worker threads
+    std::mutex progress_mutex;
+
+    bool prepareJobs(git_repository *repo, const std::vector<std::string> *remote_names) {
+        std::vector<std::string> names;
+        if (remote_names != NULL) {
+            names = *remote_names;
+        } else {
+            git_strarray list;
+            if (reportError(git_remote_list(&list, repo), "git fetch: Cannot list remotes"))
+                return false;
+
+            for(size_t i = 0; i < list.count; i++) {
+                names.push_back(list.strings[i]);
+            }
+            git_strarray_dispose(&list);
+        }
+
+        jobs.resize(names.size());
+        for(size_t i = 0; i < names.size(); i++) {
+            jobs[i].handler = this;
+            jobs[i].name = names[i];
+            memset(&jobs[i].stats, 0, sizeof(jobs[i].stats));
+        }
+
+        return !jobs.empty();
+    }
+
+    void setupCallbacks(git_remote_callbacks *callbacks, Job &job) {
+        callbacks->sideband_progress = sideband_progress;
+        callbacks->credentials = credentials;
+        callbacks->transfer_progress = transfer_progress;
+        callbacks->update_tips = update_tips;
+        callbacks->payload = &job;
+    }
+
+    /**
+     * Download the objects of one remote into the repository, on a worker thread
+     */
+    void download(Job &job) {
+        git_fetch_options options;
+        git_fetch_options_init(&options, GIT_FETCH_OPTIONS_VERSION);
+        setupCallbacks(&options.callbacks, job);
+
+        int error = git_repository_open(&job.repo, repo_path.c_str());
+        if (error == 0)
+            error = git_remote_lookup(&job.remote, job.repo, job.name.c_str());
+        if (error == 0)
+            error = git_remote_download(job.remote, NULL, &options);
+
+        if (job.remote != NULL)
+            git_remote_disconnect(job.remote);
+
+        if (error != 0) {
+            job.error = error;
+            const git_error *err = git_error_last();
+            if (err != NULL) {
+                job.error_class = err->klass;
+                job.error_message = err->message;
+            }
+        }
+    }
+
+    /**
+     * Update the references of all downloaded remotes, then report the failed ones
+     */
+    void updateTips() {
+        for(auto &job : jobs) {
+            if (job.error != 0)
+                continue;
+
+            git_remote_callbacks callbacks;
+            git_remote_init_callbacks(&callbacks, GIT_REMOTE_CALLBACKS_VERSION);
+            setupCallbacks(&callbacks, job);
+
+            // FETCH_HEAD is left alone as libgit2 would overwrite it with each remote in turn
+            std::string message = "fetch " + job.name;
+            if (reportError(git_remote_update_tips(job.remote, &callbacks, 0, GIT_REMOTE_DOWNLOAD_TAGS_UNSPECIFIED, message.c_str()),
+                            "git fetch: Cannot update references"))
+                continue;
+
+            if (git_remote_prune_refs(job.remote))
+                reportError(git_remote_prune(job.remote, &callbacks), "git fetch: Cannot prune references");
+        }
+
+        for(auto &job : jobs) {
+            if (job.error == 0)
+                continue;
+
+            if (job.error_message.empty())
+                git_error_clear();
+            else
+                git_error_set_str(job.error_class, job.error_message.c_str());
+
+            std::string message = "git fetch " + job.name + " failed";
+            reportError(job.error, message.c_str());
+        }
+    }
+
+    static int sideband_progress(const char *str, int len, void *payload) {
+        Job *job = (Job*)payload;
+        NSString *msg = [NSString stringWithFormat:@"%s: %@", job->name.c_str(), NSStringFromBuffer(str, len)];
+
+        std::lock_guard<std::mutex> lock(job->handler->progress_mutex);
+        [job->handler->remoteProgress onSidebandProgress :msg];
+
+        return 0;
+    }
+
+    static int credentials(git_credential **out, const char *url, const char *username_from_url, unsigned int allowed_types, void *payload) {
+        Job *job = (Job*)payload;
+
+        std::lock_guard<std::mutex> lock(job->handler->progress_mutex);
+        return RemoteProgressReporter::acquireCredential(out, url, job->handler->remoteProgress);
+    }
+
+    static int transfer_progress(const git_indexer_progress *stats, void *payload) {
+        Job *job = (Job*)payload;
+        MultiFetchHandler *handler = job->handler;
+
+        std::lock_guard<std::mutex> lock(handler->progress_mutex);
+        job->stats = *stats;
+
+        git_indexer_progress total;
+        memset(&total, 0, sizeof(total));
+        for(const auto &j : handler->jobs) {
+            total.total_objects += j.stats.total_objects;
+            total.indexed_objects += j.stats.indexed_objects;
+            total.received_objects += j.stats.received_objects;
+            total.local_objects += j.stats.local_objects;
+            total.total_deltas += j.stats.total_deltas;
+            total.indexed_deltas += j.stats.indexed_deltas;
+            total.received_bytes += j.stats.received_bytes;
+        }
+
+        [handler->remoteProgress onTransferProgress
+                        :total.total_objects
+                        :total.indexed_objects
+                        :total.received_objects
+                        :total.local_objects
+                        :total.total_deltas
+                        :total.indexed_deltas
+                        :total.received_bytes];
+
+        return 0;
+    }
+
+    static int update_tips(const char *refname, const git_oid *a, const git_oid *b, void *payload) {
+        Job *job = (Job*)payload;
+
+        std::lock_guard<std::mutex> lock(job->handler->progress_mutex);
+        [job->handler->remoteProgress onUpdateTips
+                        :NSStringFromCString(refname)
+                        :[[OID alloc] init :a]
+                        :[[OID alloc] init :b]];
+
+        return 0;
+    }
+};
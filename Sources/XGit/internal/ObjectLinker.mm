@@ -0,0 +1,280 @@
+//
+//  ObjectLinker.mm
+//  Populate the object database of a new repository from a local one without copying data
+//
+//  Object files (loose objects, packs and their indexes) are immutable once written, so the
+//  new repository can share them: each file is cloned (copy-on-write on APFS), else hard
+//  linked, and only copied when neither is possible (e.g. across file systems). With a
+//  reference repository, the objects it already has are not linked at all but borrowed
+//  through `objects/info/alternates` like `git clone --reference`.
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <string>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(__APPLE__)
+#include <sys/clonefile.h>
+#endif
+
+struct ObjectLinker {
+
+    struct Result {
+        size_t cloned = 0;
+        size_t linked = 0;
+        size_t copied = 0;
+        size_t borrowed = 0;
+    };
+
+    /**
+     * @param reference_odb Object database of the reference repository, or NULL for none
+     * @param reference_objects Objects directory of the reference repository
+     */
+    ObjectLinker(const std::string &source_objects, const std::string &target_objects,
+                 git_odb *reference_odb, const std::string &reference_objects):
+        source_objects(source_objects),
+        target_objects(target_objects),
+        reference_odb(reference_odb),
+        reference_objects(reference_objects) {
+    }
+
+    /**
+     * @return 0 on success or -1 with the libgit2 error set
+     */
+    int link(Result &result) {
+        if (!reference_objects.empty() && addAlternate(reference_objects) != 0)
+            return -1;
+
+        // Objects the source itself borrows must stay reachable from the new repository
+        if (copyAlternates() != 0)
+            return -1;
+
+        borrows_packs = hasBorrowedPack();
+
+        return linkDirectory("", result);
+    }
+
+private:
+    std::string source_objects;
+    std::string target_objects;
+    git_odb *reference_odb;
+    std::string reference_objects;
+
+    // Whether some packs of the source are borrowed and thus missing from the new repository
+    bool borrows_packs = false;
+
+    int linkDirectory(const std::string &relative_dir, Result &result) {
+        std::string source_dir = source_objects + "/" + relative_dir;
+        DIR *d = opendir(source_dir.c_str());
+        if (d == NULL)
+            return osError("Cannot read directory", source_dir);
+
+        int error = 0;
+        while (auto entry = readdir(d)) {
+            std::string name = entry->d_name;
+            if (name == "." || name == ".." || isTemporary(name))
+                continue;
+
+            std::string relative_path = relative_dir + name;
+            if (relative_path == "info/alternates" || (borrows_packs && isPackListing(relative_path)))
+                continue;
+
+            std::string source_path = source_objects + "/" + relative_path;
+            std::string target_path = target_objects + "/" + relative_path;
+
+            struct stat st;
+            if (lstat(source_path.c_str(), &st) != 0)
+                continue; // Removed meanwhile e.g. by a repack of the source
+
+            if (S_ISDIR(st.st_mode)) {
+                if (mkdir(target_path.c_str(), 0755) != 0 && errno != EEXIST) {
+                    error = osError("Cannot create directory", target_path);
+                    break;
+                }
+
+                if ((error = linkDirectory(relative_path + "/", result)) != 0)
+                    break;
+            } else if (S_ISREG(st.st_mode)) {
+                if (isBorrowed(relative_dir, name)) {
+                    result.borrowed++;
+                    continue;
+                }
+
+                if ((error = linkFile(source_path, target_path, st.st_mode & 0777, result)) != 0)
+                    break;
+            }
+        }
+        closedir(d);
+
+        return error;
+    }
+
+    static bool isTemporary(const std::string &name) {
+        // Objects and packs being written by git and libgit2
+        return name.compare(0, 4, "tmp_") == 0 || name.compare(0, 10, "pack_git2_") == 0;
+    }
+
+    /**
+     * Files listing the packs of the repository (with their bitmaps and reverse indexes for
+     * the multi-pack index), which would refer to the borrowed packs as local ones
+     */
+    static bool isPackListing(const std::string &relative_path) {
+        return relative_path == "info/packs" || relative_path.compare(0, 21, "pack/multi-pack-index") == 0;
+    }
+
+    bool hasBorrowedPack() {
+        if (reference_odb == NULL)
+            return false;
+
+        DIR *d = opendir((source_objects + "/pack").c_str());
+        if (d == NULL)
+            return false;
+
+        bool found = false;
+        while (auto entry = readdir(d)) {
+            std::string name = entry->d_name;
+            if (name.size() > 5 && name.compare(name.size() - 5, 5, ".pack") == 0 && isBorrowed("pack/", name)) {
+                found = true;
+                break;
+            }
+        }
+        closedir(d);
+
+        return found;
+    }
+
+    /**
+     * Whether the reference repository has this file's objects, which then need no link
+     */
+    bool isBorrowed(const std::string &relative_dir, const std::string &name) {
+        if (reference_odb == NULL)
+            return false;
+
+        // Loose object "xx/yyyy...": look it up as the reference may have packed it
+        if (relative_dir.size() == 3 && name.size() == GIT_OID_HEXSZ - 2) {
+            git_oid oid;
+            if (git_oid_fromstr(&oid, (relative_dir.substr(0, 2) + name).c_str()) != 0)
+                return false;
+
+            return git_odb_exists(reference_odb, &oid) != 0;
+        }
+
+        // Pack names are derived from their content so the same name means the same objects.
+        // The index, bitmap etc. of a pack go with it even if the reference lacks some of them.
+        if (relative_dir == "pack/" && name.compare(0, 5, "pack-") == 0) {
+            struct stat st;
+            return stat((reference_objects + "/pack/" + name.substr(0, name.find('.')) + ".pack").c_str(), &st) == 0;
+        }
+
+        return false;
+    }
+
+    static int linkFile(const std::string &source_path, const std::string &target_path, mode_t mode, Result &result) {
+#if defined(__APPLE__)
+        if (clonefile(source_path.c_str(), target_path.c_str(), 0) == 0) {
+            result.cloned++;
+            return 0;
+        }
+#endif
+        if (::link(source_path.c_str(), target_path.c_str()) == 0) {
+            result.linked++;
+            return 0;
+        }
+
+        if (errno == EEXIST)
+            return 0;
+
+        if (copyFile(source_path, target_path, mode) != 0)
+            return osError("Cannot copy object file", source_path);
+
+        result.copied++;
+        return 0;
+    }
+
+    static int copyFile(const std::string &source_path, const std::string &target_path, mode_t mode) {
+        int in = open(source_path.c_str(), O_RDONLY);
+        if (in < 0)
+            return -1;
+
+        int out = open(target_path.c_str(), O_WRONLY | O_CREAT | O_EXCL, mode);
+        if (out < 0) {
+            close(in);
+            return -1;
+        }
+
+        char buffer[64 * 1024];
+        ssize_t n;
+        int error = 0;
+        while ((n = read(in, buffer, sizeof(buffer))) > 0) {
+            if (write(out, buffer, n) != n) {
+                error = -1;
+                break;
+            }
+        }
+        if (n < 0)
+            error = -1;
+
+        close(in);
+        if (close(out) != 0)
+            error = -1;
+        if (error != 0)
+            unlink(target_path.c_str());
+
+        return error;
+    }
+
+    /**
+     * Append the source's alternates, with relative paths made absolute since they are
+     * relative to the objects directory that contains the file
+     */
+    int copyAlternates() {
+        FILE *f = fopen((source_objects + "/info/alternates").c_str(), "r");
+        if (f == NULL)
+            return 0;
+
+        int error = 0;
+        char line[4096];
+        while (error == 0 && fgets(line, sizeof(line), f) != NULL) {
+            std::string path = line;
+            while (!path.empty() && (path.back() == '\n' || path.back() == '\r'))
+                path.pop_back();
+
+            if (path.empty() || path[0] == '#')
+                continue;
+
+            if (path[0] != '/')
+                path = source_objects + "/" + path;
+
+            error = addAlternate(path);
+        }
+        fclose(f);
+
+        return error;
+    }
+
+    int addAlternate(const std::string &objects_dir) {
+        std::string path = target_objects + "/info/alternates";
+        FILE *f = fopen(path.c_str(), "a");
+        if (f == NULL)
+            return osError("Cannot write alternates", path);
+
+        bool ok = fprintf(f, "%s\n", objects_dir.c_str()) >= 0;
+        if (fclose(f) != 0 || !ok)
+            return osError("Cannot write alternates", path);
+
+        return 0;
+    }
+
+    static int osError(const char *message, const std::string &path) {
+        std::string text = std::string(message) + " '" + path + "': " + strerror(errno);
+        git_error_set_str(GIT_ERROR_OS, text.c_str());
+
+        return -1;
+    }
+};
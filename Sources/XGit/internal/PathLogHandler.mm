@@ -0,0 +1,193 @@
+//
+//  PathLogHandler.mm
+//  Single-use struct to perform path-filtered git log (i.e. `git log -- <paths>`)
+//
+//  History is simplified the same way as git's default mode: a commit is shown if it is
+//  not TREESAME (w.r.t. the paths) to any of its parents and a merge that is TREESAME to
+//  one of its parents only has that parent followed.
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <functional>
+
+#import "ChangedPathsIndex.mm"
+
+struct PathLogHandler {
+
+    PathLogHandler(ChangedPathsIndex * _Nullable index, NSArray<NSString*> * _Nonnull paths) {
+        this->index = index;
+        for(NSString *path in paths) {
+            auto p = ChangedPathsIndex::normalizePath([path UTF8String]);
+            if (p.empty()) {
+                // The whole tree is requested so there is nothing to filter
+                this->paths.clear();
+                break;
+            }
+            this->paths.push_back(p);
+        }
+    }
+
+    ~PathLogHandler() {
+        git_revwalk_free(walk);
+    }
+
+    void log(git_repository *repo, std::function<void(const git_oid&)> addCommit) {
+        if (git_revwalk_new(&walk, repo) != 0)
+            return;
+
+        // Push all references as starting points and remember them as the tips of
+        // the simplified history
+        git_reference_foreach_name(repo, [](const char *name, void *payload) {
+            PathLogHandler *handler = (PathLogHandler*) payload;
+            git_revwalk_push_ref(handler->walk, name);
+
+            git_reference *ref;
+            if (git_reference_lookup(&ref, git_revwalk_repository(handler->walk), name) == 0) {
+                git_object *target;
+                if (git_reference_peel(&target, ref, GIT_OBJECT_COMMIT) == 0) {
+                    handler->reachable.insert(*git_object_id(target));
+                    git_object_free(target);
+                }
+                git_reference_free(ref);
+            }
+
+            return 0;
+        }, this);
+
+        git_revwalk_sorting(walk, GIT_SORT_TIME | GIT_SORT_TOPOLOGICAL);
+
+        // Topological order guarantees that we visit a commit after all its children
+        // so `reachable` is complete by the time we get to it.
+        git_oid commit_oid;
+        while (git_revwalk_next(&commit_oid, walk) == 0) {
+            if (reachable.find(commit_oid) == reachable.end())
+                continue;
+
+            git_commit *commit;
+            if (git_commit_lookup(&commit, repo, &commit_oid) != 0)
+                continue;
+
+            if (visit(commit)) {
+                addCommit(commit_oid);
+            }
+
+            git_commit_free(commit);
+        }
+    }
+
+private:
+    ChangedPathsIndex *index;
+    std::vector<std::string> paths;
+    git_revwalk *walk = NULL;
+    std::set<git_oid, OIDCompare> reachable;
+
+    /**
+     * Decide whether the commit should be shown and mark the parents to follow
+     */
+    bool visit(git_commit *commit) {
+        auto num_parents = git_commit_parentcount(commit);
+
+        if (num_parents == 0)
+            return touchesPaths(commit);
+
+        for(unsigned int i = 0; i < num_parents; i++) {
+            if (isTreeSame(commit, i)) {
+                // Only follow the first TREESAME parent
+                reachable.insert(*git_commit_parent_id(commit, i));
+                return false;
+            }
+        }
+
+        for(unsigned int i = 0; i < num_parents; i++) {
+            reachable.insert(*git_commit_parent_id(commit, i));
+        }
+
+        return true;
+    }
+
+    bool isTreeSame(git_commit *commit, unsigned int parent_index) {
+        if (paths.empty()) {
+            git_commit *parent;
+            if (git_commit_parent(&parent, commit, parent_index) != 0)
+                return false;
+
+            bool result = git_oid_equal(git_commit_tree_id(commit), git_commit_tree_id(parent));
+            git_commit_free(parent);
+
+            return result;
+        }
+
+        // Filters are computed against the first parent only
+        if (parent_index == 0 && index != NULL &&
+            index->query(*git_commit_id(commit), paths) == ChangedPathsIndex::NOT_CHANGED)
+            return true;
+
+        git_commit *parent = NULL;
+        git_tree *tree = NULL, *parent_tree = NULL;
+        bool result = false;
+
+        if (git_commit_tree(&tree, commit) == 0 &&
+            git_commit_parent(&parent, commit, parent_index) == 0 &&
+            git_commit_tree(&parent_tree, parent) == 0) {
+            result = true;
+            for(const auto &path : paths) {
+                if (!sameEntry(tree, parent_tree, path.c_str())) {
+                    result = false;
+                    break;
+                }
+            }
+        }
+
+        git_tree_free(parent_tree);
+        git_tree_free(tree);
+        git_commit_free(parent);
+
+        return result;
+    }
+
+    /** Root commits are shown if they introduce any of the paths */
+    bool touchesPaths(git_commit *commit) {
+        if (paths.empty())
+            return true;
+
+        git_tree *tree;
+        if (git_commit_tree(&tree, commit) != 0)
+            return false;
+
+        bool result = false;
+        for(const auto &path : paths) {
+            git_tree_entry *entry;
+            if (git_tree_entry_bypath(&entry, tree, path.c_str()) == 0) {
+                git_tree_entry_free(entry);
+                result = true;
+                break;
+            }
+        }
+
+        git_tree_free(tree);
+
+        return result;
+    }
+
+    /**
+     * Compare the entries (file or sub-directory) at the path of two trees. This only
+     * looks up the trees along the path instead of diffing the whole trees.
+     */
+    static bool sameEntry(git_tree *a, git_tree *b, const char *path) {
+        git_tree_entry *entry_a = NULL, *entry_b = NULL;
+        bool found_a = (git_tree_entry_bypath(&entry_a, a, path) == 0);
+        bool found_b = (git_tree_entry_bypath(&entry_b, b, path) == 0);
+
+        bool result = (found_a == found_b);
+        if (found_a && found_b) {
+            result = git_oid_equal(git_tree_entry_id(entry_a), git_tree_entry_id(entry_b)) &&
+                     git_tree_entry_filemode(entry_a) == git_tree_entry_filemode(entry_b);
+        }
+
+        git_tree_entry_free(entry_a);
+        git_tree_entry_free(entry_b);
+
+        return result;
+    }
+};
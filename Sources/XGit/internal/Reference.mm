@@ -5,6 +5,8 @@
 //  Created by Lightech on 10/24/2048.
 //
 
+#import "StringInterner.mm"
+
 @implementation Reference
 {
     @public git_reference *ref;
@@ -16,12 +18,12 @@
     return self;
 }
 
-- (void)setLibGit2Reference:(git_reference* _Nonnull)ref
+- (void)setLibGit2Reference:(git_reference* _Nonnull)ref :(StringInterner&)interner
 {
     self->ref = ref;
 
-    self->_name = NSStringFromCString(git_reference_name(ref));
-    self->_shorthand = NSStringFromCString(git_reference_shorthand(ref));
+    self->_name = interner.intern(git_reference_name(ref));
+    self->_shorthand = interner.intern(git_reference_shorthand(ref));
 
     self->_isSymbolic = (git_reference_type(ref) == GIT_REFERENCE_SYMBOLIC);
     self->_isBranch = (git_reference_is_branch(ref) != 0);
@@ -30,7 +32,7 @@
 
     const char *branch_name = NULL;
     git_branch_name(&branch_name, ref);
-    self->_branchName = NSStringFromCString(branch_name);
+    self->_branchName = interner.intern(branch_name);
 }
 
 - (void)dealloc
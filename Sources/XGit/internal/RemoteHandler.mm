@@ -2,10 +2,23 @@
 //  RemoteHandler.mm
 //  Single-use struct to perform remote git operations (git clone, git fetch, git push)
 //
+//  A clone from a repository on this machine (a path or a file:// URL) does not go through
+//  the transport, which would pack and copy every object: the object files are shared with
+//  ObjectLinker, the references are copied and only the checkout remains.
+//
 //  Created by Lightech on 10/24/2048.
 //
 
+#include <string>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 #import "RemoteProgressReporter.mm"
+#import "ObjectLinker.mm"
 #import "CheckoutProgressReporter.mm"
 #import "GitErrorReporter.mm"
 
@@ -23,7 +36,17 @@ struct RemoteHandler: RemoteProgressReporter, GitErrorReporter, CheckoutProgress
         CheckoutProgressReporter(checkoutProgress) {
     }
 
+    ~RemoteHandler() {
+        git_odb_free(reference_odb);
+        git_repository_free(reference);
+        git_repository_free(source);
+    }
+
     int clone(git_repository **repo, const char* remote_url, const char* repo_path) {
+        std::string source_path;
+        if (localSourcePath(remote_url, source_path))
+            return cloneLocal(repo, remote_url, source_path.c_str(), repo_path, NULL);
+
         git_clone_options options;
         git_clone_options_init(&options, GIT_CLONE_OPTIONS_VERSION);
         setupCallbacks(&options.fetch_opts.callbacks);
@@ -36,6 +59,23 @@ struct RemoteHandler: RemoteProgressReporter, GitErrorReporter, CheckoutProgress
         return error;
     }
 
+    /**
+     * Clone a local repository, borrowing the objects of a reference repository through
+     * alternates (`git clone --reference`). The source itself can be the reference
+     * (`git clone --shared`), in which case no object is shared or copied at all.
+     */
+    int cloneWithReference(git_repository **repo, const char* remote_url, const char* repo_path, const char* reference_path) {
+        std::string source_path;
+        if (!localSourcePath(remote_url, source_path)) {
+            git_error_set_str(GIT_ERROR_INVALID, "A reference repository requires a local source repository");
+            reportError(GIT_EINVALID, "git clone failed");
+            onComplete();
+            return GIT_EINVALID;
+        }
+
+        return cloneLocal(repo, remote_url, source_path.c_str(), repo_path, reference_path);
+    }
+
     // Push all branches and tags to remote
     void push(git_repository *repo, bool force, git_remote *remote) {
         git_push_options options;
@@ -69,6 +109,315 @@ struct RemoteHandler: RemoteProgressReporter, GitErrorReporter, CheckoutProgress
     }
 
 private:
+    git_repository *source = NULL;
+    git_repository *reference = NULL;
+    git_odb *reference_odb = NULL;
+
+    // Whether cloneLocalInto created the new repository, which is removed on failure
+    bool initialized = false;
+
+    /**
+     * The directory of the repository to clone if the URL designates one on this machine
+     */
+    static bool localSourcePath(const char *remote_url, std::string &path) {
+        if (strncmp(remote_url, "file://", 7) == 0) {
+            // Like libgit2's git_fs_path_fromurl: "file:///path" or "file://localhost/path"
+            const char *url_path = remote_url + 7;
+            if (strncmp(url_path, "localhost/", 10) == 0)
+                url_path += 9;
+            if (url_path[0] != '/')
+                return false;
+
+            path = percentDecode(url_path);
+        } else if (strstr(remote_url, "://") == NULL) {
+            path = remote_url; // Could also be "host:path" for ssh which then does not exist
+        } else {
+            return false;
+        }
+
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    /**
+     * Decode the %XX escapes of a URL path, keeping invalid ones as they are
+     */
+    static std::string percentDecode(const char *url_path) {
+        std::string result;
+        for(const char *p = url_path; *p != '\0'; p++) {
+            int high, low;
+            if (*p == '%' && (high = hexValue(p[1])) >= 0 && (low = hexValue(p[2])) >= 0) {
+                result.push_back((char)(high * 16 + low));
+                p += 2;
+            } else {
+                result.push_back(*p);
+            }
+        }
+
+        return result;
+    }
+
+    static int hexValue(char c) {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+
+        return -1;
+    }
+
+    int cloneLocal(git_repository **repo, const char *remote_url, const char *source_path, const char *repo_path, const char *reference_path) {
+        struct stat st;
+        bool target_existed = (stat(repo_path, &st) == 0);
+
+        auto error = cloneLocalInto(repo, remote_url, source_path, repo_path, reference_path);
+
+        // Like git_clone, do not leave a half-built repository behind
+        if (error != 0 && initialized) {
+            git_repository_free(*repo);
+            *repo = NULL;
+            removeDirectory(repo_path, !target_existed);
+        }
+
+        reportError(error, "git clone failed");
+        onComplete();
+
+        return error;
+    }
+
+    int cloneLocalInto(git_repository **repo, const char *remote_url, const char *source_path, const char *repo_path, const char *reference_path) {
+        int error = git_repository_open(&source, source_path);
+        if (error != 0)
+            return error;
+
+        if (!isEmptyDirectory(repo_path)) {
+            git_error_set_str(GIT_ERROR_INVALID, "The destination path exists and is not an empty directory");
+            return GIT_EEXISTS;
+        }
+
+        std::string source_objects, reference_objects;
+        if ((error = objectsDirectory(source, source_objects)) != 0)
+            return error;
+
+        if (reference_path != NULL) {
+            if ((error = git_repository_open(&reference, reference_path)) != 0 ||
+                (error = git_repository_odb(&reference_odb, reference)) != 0 ||
+                (error = objectsDirectory(reference, reference_objects)) != 0)
+                return error;
+        }
+
+        if ((error = git_repository_init(repo, repo_path, 0)) != 0)
+            return error;
+        initialized = true;
+
+        std::string target_objects;
+        if ((error = objectsDirectory(*repo, target_objects)) != 0)
+            return error;
+
+        ObjectLinker::Result linked;
+        if ((error = ObjectLinker(source_objects, target_objects, reference_odb, reference_objects).link(linked)) != 0)
+            return error;
+
+        onSidebandProgress([NSString stringWithFormat:@"Shared %zu object files (%zu cloned, %zu linked), copied %zu, borrowed %zu\n",
+                        linked.cloned + linked.linked, linked.cloned, linked.linked, linked.copied, linked.borrowed]);
+
+        // Packs added after the object database was loaded are only found after a refresh
+        git_odb *odb = NULL;
+        if ((error = git_repository_odb(&odb, *repo)) != 0)
+            return error;
+        error = git_odb_refresh(odb);
+        git_odb_free(odb);
+        if (error != 0)
+            return error;
+
+        // Like git clone, a relative path is stored absolute so that origin does not depend
+        // on the working directory of the process
+        std::string origin_url = remote_url;
+        if (strstr(remote_url, "://") == NULL && remote_url[0] != '/') {
+            char *absolute_path = realpath(source_path, NULL);
+            if (absolute_path == NULL) {
+                git_error_set_str(GIT_ERROR_OS, (std::string("Cannot resolve path '") + source_path + "': " + strerror(errno)).c_str());
+                return GIT_ERROR;
+            }
+            origin_url = absolute_path;
+            free(absolute_path);
+        }
+
+        git_remote *origin = NULL;
+        if ((error = git_remote_create(&origin, *repo, "origin", origin_url.c_str())) != 0)
+            return error;
+        git_remote_free(origin);
+
+        std::string log_message = std::string("clone: from ") + origin_url;
+        if ((error = copyReferences(*repo, log_message)) != 0)
+            return error;
+
+        bool has_commit = false;
+        if ((error = setupHead(*repo, log_message, has_commit)) != 0 || !has_commit)
+            return error;
+
+        git_checkout_options checkout_options;
+        git_checkout_options_init(&checkout_options, GIT_CHECKOUT_OPTIONS_VERSION);
+        checkout_options.checkout_strategy = GIT_CHECKOUT_SAFE;
+        setupCheckoutCallbacks(&checkout_options);
+
+        return git_checkout_head(*repo, &checkout_options);
+    }
+
+    static bool isEmptyDirectory(const char *path) {
+        DIR *d = opendir(path);
+        if (d == NULL)
+            return errno == ENOENT;
+
+        bool empty = true;
+        while (auto entry = readdir(d)) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                empty = false;
+                break;
+            }
+        }
+        closedir(d);
+
+        return empty;
+    }
+
+    /**
+     * Remove the content of a directory, and the directory itself if `remove_root`
+     */
+    static void removeDirectory(const std::string &path, bool remove_root) {
+        DIR *d = opendir(path.c_str());
+        if (d != NULL) {
+            while (auto entry = readdir(d)) {
+                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                    continue;
+
+                std::string entry_path = path + "/" + entry->d_name;
+                struct stat st;
+                if (lstat(entry_path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+                    removeDirectory(entry_path, true);
+                else
+                    unlink(entry_path.c_str());
+            }
+            closedir(d);
+        }
+
+        if (remove_root)
+            rmdir(path.c_str());
+    }
+
+    static int objectsDirectory(git_repository *repo, std::string &path) {
+        git_buf buf = { NULL, 0, 0 };
+        int error = git_repository_item_path(&buf, repo, GIT_REPOSITORY_ITEM_OBJECTS);
+        if (error == 0) {
+            path.assign(buf.ptr, buf.size);
+            while (path.size() > 1 && path.back() == '/')
+                path.pop_back();
+        }
+        git_buf_dispose(&buf);
+
+        return error;
+    }
+
+    /**
+     * Create the remote-tracking branches and the tags of the source, like a fetch with
+     * the default refspec of origin would
+     */
+    int copyReferences(git_repository *repo, const std::string &log_message) {
+        git_reference_iterator *iter = NULL;
+        int error = git_reference_iterator_new(&iter, source);
+        if (error != 0)
+            return error;
+
+        git_reference *ref = NULL;
+        while ((error = git_reference_next(&ref, iter)) == 0) {
+            std::string name = git_reference_name(ref);
+            const git_oid *target = git_reference_target(ref);
+
+            std::string local_name;
+            if (name.compare(0, 11, "refs/heads/") == 0)
+                local_name = "refs/remotes/origin/" + name.substr(11);
+            else if (name.compare(0, 10, "refs/tags/") == 0)
+                local_name = name;
+
+            if (target != NULL && !local_name.empty()) {
+                git_reference *created = NULL;
+                error = git_reference_create(&created, repo, local_name.c_str(), target, 1, log_message.c_str());
+                git_reference_free(created);
+            }
+            git_reference_free(ref);
+
+            if (error != 0)
+                break;
+        }
+        git_reference_iterator_free(iter);
+
+        return (error == GIT_ITEROVER) ? 0 : error;
+    }
+
+    /**
+     * Point HEAD like the source's HEAD, on a local branch tracking its origin counterpart
+     *
+     * @param has_commit Set to whether HEAD has a commit to check out (not an unborn branch)
+     */
+    int setupHead(git_repository *repo, const std::string &log_message, bool &has_commit) {
+        git_reference *source_head = NULL;
+        int error = git_reference_lookup(&source_head, source, "HEAD");
+        if (error != 0)
+            return error;
+
+        if (git_reference_type(source_head) != GIT_REFERENCE_SYMBOLIC) {
+            // Detached HEAD
+            git_oid oid;
+            git_oid_cpy(&oid, git_reference_target(source_head));
+            git_reference_free(source_head);
+
+            has_commit = true;
+            return git_repository_set_head_detached(repo, &oid);
+        }
+
+        std::string branch_name = git_reference_symbolic_target(source_head);
+        git_reference_free(source_head);
+
+        git_oid oid;
+        error = git_reference_name_to_id(&oid, source, branch_name.c_str());
+        if (error == GIT_ENOTFOUND) {
+            // Empty source: stay on the unborn branch
+            has_commit = false;
+            return git_repository_set_head(repo, branch_name.c_str());
+        }
+        if (error != 0)
+            return error;
+
+        if (branch_name.compare(0, 11, "refs/heads/") != 0) {
+            has_commit = true;
+            return git_repository_set_head_detached(repo, &oid);
+        }
+
+        std::string short_name = branch_name.substr(11);
+        std::string tracking_name = "refs/remotes/origin/" + short_name;
+
+        git_reference *origin_head = NULL;
+        error = git_reference_symbolic_create(&origin_head, repo, "refs/remotes/origin/HEAD", tracking_name.c_str(), 1, log_message.c_str());
+        git_reference_free(origin_head);
+        if (error != 0)
+            return error;
+
+        git_commit *commit = NULL;
+        git_reference *branch = NULL;
+        if ((error = git_commit_lookup(&commit, repo, &oid)) == 0 &&
+            (error = git_branch_create(&branch, repo, short_name.c_str(), commit, 1)) == 0)
+            error = git_branch_set_upstream(branch, ("origin/" + short_name).c_str());
+        git_reference_free(branch);
+        git_commit_free(commit);
+        if (error != 0)
+            return error;
+
+        has_commit = true;
+        return git_repository_set_head(repo, branch_name.c_str());
+    }
+
     struct RefspecList {
         RefspecList(git_reference *ref, bool force) {
             auto refname = git_reference_name(ref);
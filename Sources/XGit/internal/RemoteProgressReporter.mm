@@ -29,25 +29,27 @@ struct RemoteProgressReporter {
         [remoteProgress onComplete];
     }
 
-private:
-    id<RemoteProgressProtocol> remoteProgress;
-
-    static int sideband_progress(const char *str, int len, void *payload) {
-        NSString *msg = NSStringFromBuffer(str, len);
-        [((RemoteProgressReporter*)payload)->remoteProgress onSidebandProgress :msg];
-
-        return 0;
+    void onSidebandProgress(NSString *message) {
+        [remoteProgress onSidebandProgress :message];
     }
 
-    static int credentials(git_credential **out, const char *url, const char *username_from_url, unsigned int allowed_types, void *payload) {
-        id<CredentialProtocol> cred = [((RemoteProgressReporter*)payload)->remoteProgress getCredential];
+    /**
+     * Create the credential supplied by the progress object for the remote at `url`,
+     * shared by all remote callbacks
+     */
+    static int acquireCredential(git_credential **out, const char *url, id<RemoteProgressProtocol> remoteProgress) {
+        id<CredentialProtocol> cred = nil;
+        if (url != NULL && [(id)remoteProgress respondsToSelector:@selector(getCredentialForUrl:)])
+            cred = [remoteProgress getCredentialForUrl :NSStringFromCString(url)];
+        else
+            cred = [remoteProgress getCredential];
 
         if (!cred) {
             // RemoteProgressProtocol does not supply a credential
             // Raise an error here since we need a credential
             // Ideally, we should have access to error reporter, but since we don't, we add the
             // mustSupplyCredential temporarily.
-            [((RemoteProgressReporter*)payload)->remoteProgress mustSupplyCredential];
+            [remoteProgress mustSupplyCredential];
             return -1;
         }
 
@@ -69,6 +71,20 @@ private:
         }
     }
 
+private:
+    id<RemoteProgressProtocol> remoteProgress;
+
+    static int sideband_progress(const char *str, int len, void *payload) {
+        NSString *msg = NSStringFromBuffer(str, len);
+        [((RemoteProgressReporter*)payload)->remoteProgress onSidebandProgress :msg];
+
+        return 0;
+    }
+
+    static int credentials(git_credential **out, const char *url, const char *username_from_url, unsigned int allowed_types, void *payload) {
+        return acquireCredential(out, url, ((RemoteProgressReporter*)payload)->remoteProgress);
+    }
+
     static int transfer_progress(const git_indexer_progress *stats, void *payload) {
         [((RemoteProgressReporter*)payload)->remoteProgress onTransferProgress
                         :stats->total_objects
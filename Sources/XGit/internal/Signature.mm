@@ -20,6 +20,19 @@
     return self;
 }
 
+/**
+ * Signature without the underlying git_signature, such as the ones shared by commits
+ */
+- (nonnull instancetype)init:(nonnull NSString*)name :(nonnull NSString*)email
+{
+    self->signature = NULL;
+
+    self->_name = name;
+    self->_email = email;
+
+    return self;
+}
+
 - (void)dealloc
 {
     git_signature_free(signature);
@@ -0,0 +1,316 @@
+//
+//  SimilarityDetector.mm
+//  Rename and copy detection with a bounded cost
+//
+//  Detection runs in two passes of git_diff_find_similar:
+//   1. An exact pass which only pairs files with the same OID. It compares the OIDs of the
+//      deltas and reads no file contents.
+//   2. A similarity pass based on libgit2's hashsig signatures. libgit2 reads both files of
+//      every pair it scores, so this pass runs on a second diff restricted to the files left
+//      unpaired by the first one: the files of a large directory move are never candidates.
+//      It is skipped when the number of (added, deleted) pairs exceeds the limit, like git's
+//      diff.renameLimit, and the signature metric below enforces the same limit as a hard cap.
+//  The result is then made of the deltas of the first diff outside of the second pass, plus
+//  the deltas of the second diff.
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <set>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+
+#import "git2/sys/hashsig.h"
+
+struct RenameOptions {
+    bool find_renames = true;
+    bool find_copies = false;
+    uint16_t rename_threshold = 50;
+    uint16_t copy_threshold = 50;
+    size_t max_comparisons = 1000 * 1000;
+
+    /**
+     * Fingerprint of the options to be part of the diff cache key
+     */
+    uint64_t fingerprint() const {
+        if (!find_renames)
+            return 0;
+
+        uint64_t h = 0xcbf29ce484222325ULL;
+        auto mix = [&h](uint64_t value) {
+            h ^= value;
+            h *= 0x100000001b3ULL;
+        };
+
+        mix(find_copies);
+        mix(rename_threshold);
+        mix(copy_threshold);
+        mix(max_comparisons);
+
+        return h;
+    }
+};
+
+struct SimilarityDetector {
+
+    /**
+     * A delta of the result, in one of the two diffs it is made of
+     */
+    struct DeltaRef {
+        git_diff *diff;
+        size_t index;
+
+        const git_diff_delta *delta() const {
+            return git_diff_get_delta(diff, index);
+        }
+    };
+
+    /**
+     * Computes the diff being analyzed again, with other options
+     */
+    typedef std::function<int(git_diff **out, const git_diff_options &opts)> DiffFunction;
+
+    SimilarityDetector(const RenameOptions &options):
+        options(options) {
+    }
+
+    ~SimilarityDetector() {
+        git_diff_free(similar);
+    }
+
+    /**
+     * Detect renames (and copies if enabled) in the diff, which are then reported as
+     * GIT_DELTA_RENAMED (GIT_DELTA_COPIED) deltas instead of separate deletes and adds.
+     * The result is given by `deltas` and is valid as long as the diff is.
+     *
+     * @param diff_opts The options the diff was computed with
+     * @param recompute Computes the same diff with other options, for the similarity pass
+     */
+    int detect(git_diff *diff, const git_diff_options &diff_opts, DiffFunction recompute) {
+        this->diff = diff;
+        if (!options.find_renames)
+            return 0;
+
+        size_t num_added, num_deleted;
+        countUnpaired(diff, num_added, num_deleted);
+        if (num_added == 0 || (num_deleted == 0 && !options.find_copies))
+            return 0;
+
+        git_diff_find_options find_opts;
+        git_diff_find_options_init(&find_opts, GIT_DIFF_FIND_OPTIONS_VERSION);
+        find_opts.flags = baseFlags() | GIT_DIFF_FIND_EXACT_MATCH_ONLY;
+        find_opts.rename_limit = SIZE_MAX; // The cap is applied on the total instead
+        int error = git_diff_find_similar(diff, &find_opts);
+        if (error != 0)
+            return error;
+
+        countUnpaired(diff, num_added, num_deleted);
+        if (num_added == 0)
+            return 0;
+
+        // Copies can come from any modified file, not only the deleted ones
+        size_t num_sources = options.find_copies ? git_diff_num_deltas(diff) : num_deleted;
+        if (num_sources == 0 || num_added > options.max_comparisons / num_sources)
+            return 0;
+
+        collectCandidates(diff);
+
+        git_diff_options opts = diff_opts;
+        opts.notify_cb = notify_candidate;
+        opts.payload = this;
+        if ((error = recompute(&similar, opts)) != 0) {
+            similar = NULL;
+            return error;
+        }
+
+        git_diff_similarity_metric metric = {
+            file_signature,
+            buffer_signature,
+            free_signature,
+            similarity,
+            this
+        };
+
+        find_opts.flags = baseFlags();
+        find_opts.rename_threshold = options.rename_threshold;
+        find_opts.copy_threshold = options.copy_threshold;
+        find_opts.metric = &metric;
+
+        // On failure the candidates stay reported as deletes and adds
+        return git_diff_find_similar(similar, &find_opts);
+    }
+
+    /**
+     * The deltas of the result, in the order libgit2 sorts a diff
+     */
+    std::vector<DeltaRef> deltas() const {
+        std::vector<DeltaRef> result;
+
+        size_t num_deltas = git_diff_num_deltas(diff);
+        for(size_t i = 0; i < num_deltas; i++) {
+            if (similar == NULL || !isCandidate(git_diff_get_delta(diff, i)))
+                result.push_back({ diff, i });
+        }
+
+        if (similar == NULL)
+            return result;
+
+        num_deltas = git_diff_num_deltas(similar);
+        for(size_t i = 0; i < num_deltas; i++) {
+            result.push_back({ similar, i });
+        }
+
+        std::stable_sort(result.begin(), result.end(), [](const DeltaRef &a, const DeltaRef &b) {
+            return strcmp(sortPath(a.delta()), sortPath(b.delta())) < 0;
+        });
+
+        return result;
+    }
+
+    /**
+     * Collect the content of the result, generating the patch of each file once
+     */
+    int collect(DiffRecord &record) const {
+        for(const auto &ref : deltas()) {
+            int error = record.collect(ref.diff, ref.index);
+            if (error != 0)
+                return error;
+        }
+
+        return 0;
+    }
+
+private:
+    const RenameOptions &options;
+
+    git_diff *diff = NULL;
+
+    // Diff of the files left unpaired by the exact pass, for the similarity pass
+    git_diff *similar = NULL;
+
+    // Path and status of the deltas of `diff` that are part of the similarity pass. Those
+    // are plain deltas so they are the same in the recomputed diff.
+    std::set<std::pair<std::string, int>> candidates;
+
+    size_t num_comparisons = 0;
+
+    uint32_t baseFlags() {
+        uint32_t flags = GIT_DIFF_FIND_RENAMES | GIT_DIFF_FIND_FOR_UNTRACKED;
+        if (options.find_copies)
+            flags |= GIT_DIFF_FIND_COPIES;
+
+        return flags;
+    }
+
+    static void countUnpaired(git_diff *diff, size_t &num_added, size_t &num_deleted) {
+        num_added = num_deleted = 0;
+
+        size_t num_deltas = git_diff_num_deltas(diff);
+        for(size_t i = 0; i < num_deltas; i++) {
+            auto status = git_diff_get_delta(diff, i)->status;
+            if (status == GIT_DELTA_ADDED || status == GIT_DELTA_UNTRACKED)
+                num_added++;
+            else if (status == GIT_DELTA_DELETED)
+                num_deleted++;
+        }
+    }
+
+    void collectCandidates(git_diff *diff) {
+        size_t num_deltas = git_diff_num_deltas(diff);
+        for(size_t i = 0; i < num_deltas; i++) {
+            auto delta = git_diff_get_delta(diff, i);
+            switch (delta->status) {
+                case GIT_DELTA_ADDED:
+                case GIT_DELTA_UNTRACKED:
+                case GIT_DELTA_DELETED:
+                    candidates.emplace(delta->old_file.path, delta->status);
+                    break;
+
+                case GIT_DELTA_MODIFIED:
+                    if (options.find_copies)
+                        candidates.emplace(delta->old_file.path, delta->status);
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+
+    bool isCandidate(const git_diff_delta *delta) const {
+        return candidates.count(std::make_pair(std::string(delta->old_file.path), (int)delta->status)) != 0;
+    }
+
+    /**
+     * Path by which libgit2 sorts the deltas of a diff
+     */
+    static const char *sortPath(const git_diff_delta *delta) {
+        if (delta->status == GIT_DELTA_ADDED || delta->status == GIT_DELTA_RENAMED || delta->status == GIT_DELTA_COPIED)
+            return delta->new_file.path;
+
+        return delta->old_file.path;
+    }
+
+    static int notify_candidate(const git_diff *diff_so_far, const git_diff_delta *delta_to_add, const char *matched_pathspec, void *payload) {
+        SimilarityDetector *detector = (SimilarityDetector*)payload;
+
+        // A positive value skips the delta
+        return detector->isCandidate(delta_to_add) ? 0 : 1;
+    }
+
+    /**
+     * Whether the file should get a signature. Returning no signature makes libgit2 give
+     * the pair a zero score without calling `similarity`.
+     */
+    bool wantsSignature() {
+        return num_comparisons < options.max_comparisons;
+    }
+
+    static int file_signature(void **out, const git_diff_file *file, const char *fullpath, void *payload) {
+        SimilarityDetector *detector = (SimilarityDetector*)payload;
+        *out = NULL;
+        if (!detector->wantsSignature())
+            return 0;
+
+        return ignoreSmallFile(git_hashsig_create_fromfile((git_hashsig**)out, fullpath, GIT_HASHSIG_SMART_WHITESPACE));
+    }
+
+    static int buffer_signature(void **out, const git_diff_file *file, const char *buf, size_t buflen, void *payload) {
+        SimilarityDetector *detector = (SimilarityDetector*)payload;
+        *out = NULL;
+        if (!detector->wantsSignature())
+            return 0;
+
+        return ignoreSmallFile(git_hashsig_create((git_hashsig**)out, buf, buflen, GIT_HASHSIG_SMART_WHITESPACE));
+    }
+
+    static int ignoreSmallFile(int error) {
+        // hashsig refuses files that are too small to be compared meaningfully
+        return (error == GIT_EBUFS) ? 0 : error;
+    }
+
+    static void free_signature(void *sig, void *payload) {
+        git_hashsig_free((git_hashsig*)sig);
+    }
+
+    static int similarity(int *score, void *siga, void *sigb, void *payload) {
+        SimilarityDetector *detector = (SimilarityDetector*)payload;
+        if (detector->num_comparisons >= detector->options.max_comparisons) {
+            *score = 0;
+            return 0;
+        }
+        detector->num_comparisons++;
+
+        int result = git_hashsig_compare((git_hashsig*)siga, (git_hashsig*)sigb);
+        if (result < 0)
+            return result;
+
+        *score = result;
+        return 0;
+    }
+};
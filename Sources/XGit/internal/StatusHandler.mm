@@ -7,15 +7,18 @@
 
 #import "StatusProtocol.h"
 #import "GitErrorReporter.mm"
+#import "SimilarityDetector.mm"
 
 struct StatusHandler: GitErrorReporter {
 
-    StatusHandler(id<StatusProtocol> gitStatusReceiver, id<ErrorReceiverProtocol> errorReceiver):
-		GitErrorReporter(errorReceiver) {
+    StatusHandler(id<StatusProtocol> gitStatusReceiver, id<ErrorReceiverProtocol> errorReceiver, const RenameOptions &rename_options, StringInterner &interner):
+		GitErrorReporter(errorReceiver), rename_options(rename_options), interner(interner) {
         this->gitStatusReceiver = gitStatusReceiver;
     }
 
     id<StatusProtocol> gitStatusReceiver;
+    const RenameOptions &rename_options;
+    StringInterner &interner;
 
     ~StatusHandler() {
         git_index_free(index);
@@ -83,7 +86,7 @@ private:
                     git_reference_is_branch(head_target_ref)) {
                     const char *result;
                     git_branch_name(&result, head_target_ref);
-                    NSString *currentBranch = NSStringFromCString(result);
+                    NSString *currentBranch = interner.intern(result);
                     [gitStatusReceiver setCurrentBranch :currentBranch];
                     git_reference_free(head_target_ref);
                 }
@@ -107,8 +110,13 @@ private:
         if (reportError(git_diff_index_to_workdir(&unstaged_changes, repo, index, &diff_opts), "Error computing unstaged changes"))
             return;
 
-        Diff* unstagedChanges = [[Diff alloc] init :unstaged_changes];
-        [gitStatusReceiver setUnstagedChanges :unstagedChanges];
+        SimilarityDetector detector(rename_options);
+        detector.detect(unstaged_changes, diff_opts, [&](git_diff **out, const git_diff_options &opts) {
+            return git_diff_index_to_workdir(out, repo, index, &opts);
+        });
+
+        [gitStatusReceiver setUnstagedChanges :getChanges(detector)];
+        git_diff_free(unstaged_changes);
     }
 
     void computeStagedChanges(git_repository *repo) {
@@ -123,7 +131,19 @@ private:
         if (reportError(git_diff_tree_to_index(&staged_changes, repo, (git_tree*)head_tree, index, &diff_opts), ""))
             return;
 
-        Diff* stagedChanges = [[Diff alloc] init :staged_changes];
-        [gitStatusReceiver setStagedChanges :stagedChanges];
+        SimilarityDetector detector(rename_options);
+        detector.detect(staged_changes, diff_opts, [&](git_diff **out, const git_diff_options &opts) {
+            return git_diff_tree_to_index(out, repo, (git_tree*)head_tree, index, &opts);
+        });
+
+        [gitStatusReceiver setStagedChanges :getChanges(detector)];
+        git_diff_free(staged_changes);
+    }
+
+    Diff * _Nonnull getChanges(const SimilarityDetector &detector) {
+        DiffRecord record;
+        detector.collect(record);
+
+        return [[Diff alloc] initWithRecord :record :interner];
     }
 };
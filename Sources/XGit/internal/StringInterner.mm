@@ -0,0 +1,129 @@
+//
+//  StringInterner.mm
+//  Per-repository table of immutable strings and signatures shared by the object model
+//
+//  A long history has many commits by few authors and a diff repeats the same paths, so
+//  model objects share one NSString (or Signature) per distinct value instead of copying it.
+//  Entries live as long as the repository.
+//
+//  Created by Lightech on 10/24/2048.
+//
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <cstring>
+
+#import "Signature.mm"
+
+struct StringInterner {
+
+    /**
+     * The shared NSString equal to the C string, or nil if it is NULL
+     */
+    NSString* _Nullable intern(const char * _Nullable text) {
+        if (text == NULL)
+            return nil;
+
+        return intern(text, strlen(text));
+    }
+
+    NSString* _Nullable intern(const char * _Nullable text, size_t length) {
+        if (text == NULL)
+            return nil;
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return internLocked(text, length);
+    }
+
+    /**
+     * The shared Signature with the same name and email. The time of the signature is not
+     * part of it, it is a property of the commit.
+     */
+    Signature* _Nonnull intern(const git_signature * _Nonnull signature) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        NSString *name = internLocked(signature->name, strlen(signature->name));
+        NSString *email = internLocked(signature->email, strlen(signature->email));
+
+        lookups++;
+        SignatureKey key((__bridge void*)name, (__bridge void*)email);
+        auto iter = signatures.find(key);
+        if (iter != signatures.end()) {
+            hits++;
+            return iter->second;
+        }
+
+        Signature *result = [[Signature alloc] init :name :email];
+        signatures[key] = result;
+
+        return result;
+    }
+
+    void getStatistics(size_t &count, size_t &bytes, size_t &lookups, size_t &hits) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        count = strings.size() + signatures.size();
+        bytes = this->bytes;
+        lookups = this->lookups;
+        hits = this->hits;
+    }
+
+private:
+    /** Non-owning reference to a string being looked up, to avoid a copy on hits */
+    struct StringRef {
+        const char *data;
+        size_t size;
+    };
+
+    struct StringCompare {
+        typedef void is_transparent;
+
+        bool operator()(const std::string &lhs, const std::string &rhs) const {
+            return lhs < rhs;
+        }
+
+        bool operator()(const StringRef &lhs, const std::string &rhs) const {
+            return compare(lhs.data, lhs.size, rhs.data(), rhs.size()) < 0;
+        }
+
+        bool operator()(const std::string &lhs, const StringRef &rhs) const {
+            return compare(lhs.data(), lhs.size(), rhs.data, rhs.size) < 0;
+        }
+
+        static int compare(const char *a, size_t a_size, const char *b, size_t b_size) {
+            int c = memcmp(a, b, (a_size < b_size) ? a_size : b_size);
+            if (c != 0)
+                return c;
+
+            return (a_size < b_size) ? -1 : (a_size > b_size) ? 1 : 0;
+        }
+    };
+
+    // Interned name and email are unique so their addresses identify a signature
+    typedef std::pair<void*, void*> SignatureKey;
+
+    std::mutex mutex;
+    std::map<std::string, NSString*, StringCompare> strings;
+    std::map<SignatureKey, Signature*> signatures;
+
+    size_t bytes = 0;
+    size_t lookups = 0;
+    size_t hits = 0;
+
+    NSString* _Nullable internLocked(const char * _Nonnull text, size_t length) {
+        lookups++;
+        auto iter = strings.find(StringRef { text, length });
+        if (iter != strings.end()) {
+            hits++;
+            return iter->second;
+        }
+
+        NSString *result = NSStringFromBuffer(text, length);
+        strings.emplace(std::string(text, length), result);
+        bytes += length;
+
+        return result;
+    }
+};
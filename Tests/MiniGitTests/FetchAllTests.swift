@@ -0,0 +1,151 @@
+    import XCTest
+    import XGit
+    @testable import MiniGit
+
+    #if os(macOS)
+    final class FetchAllTests: XCTestCase {
+
+        /// Records the events of a fetch in the order they are reported
+        class ProgressRecorder: RemoteProgressProtocol {
+            var events = [String]()
+            var updatedTips = [String]()
+            var completions = 0
+
+            func onComplete() {
+                completions += 1
+            }
+
+            func getCredential() -> CredentialProtocol? {
+                return nil
+            }
+
+            func mustSupplyCredential() {
+            }
+
+            func onSidebandProgress(_ message: String) {
+            }
+
+            func onTransferProgress(_ total_objects: UInt32, _ indexed_objects: UInt32, _ received_objects: UInt32, _ local_objects: UInt32, _ total_deltas: UInt32, _ indexed_deltas: UInt32, _ received_bytes: Int) {
+                events.append("transfer")
+            }
+
+            func onUpdateTips(_ refname: String, _ a: OID, _ b: OID) {
+                events.append("tips")
+                updatedTips.append(refname)
+            }
+
+            func onPackProgress(_ stage: Int32, _ current: UInt32, _ total: UInt32) {
+            }
+
+            func onPushTransferProgress(_ current: UInt32, _ total: UInt32, _ bytes: Int) {
+            }
+
+            func onPushUpdateReference(_ refname: String, _ status: String?) {
+            }
+
+            func onPushNegotiation(_ updates: [PushUpdate]) {
+            }
+        }
+
+        class ErrorRecorder: ErrorReceiverProtocol {
+            var messages = [String]()
+
+            func onError(_ code: Int32, _ error: GitError?, _ extra_message: String?) {
+                messages.append(extra_message ?? "")
+            }
+        }
+
+        var root: URL!
+
+        override func setUpWithError() throws {
+            root = FileManager.default.temporaryDirectory.appendingPathComponent("FetchAllTests-\(UUID())")
+            try FileManager.default.createDirectory(at: root, withIntermediateDirectories: true)
+        }
+
+        override func tearDownWithError() throws {
+            try? FileManager.default.removeItem(at: root)
+        }
+
+        func git(_ arguments: String...) throws {
+            let process = Process()
+            process.executableURL = URL(fileURLWithPath: "/usr/bin/git")
+            process.arguments = arguments
+            try process.run()
+            process.waitUntilExit()
+            XCTAssertEqual(process.terminationStatus, 0, "git \(arguments.joined(separator: " "))")
+        }
+
+        /// Create a bare repository whose main branch has one commit adding `file`
+        func makeBareRemote(_ name: String, _ file: String) throws -> URL {
+            let url = root.appendingPathComponent("\(name).git")
+            try git("init", "--bare", "--quiet", url.path)
+            addCommit(url, file)
+
+            return url
+        }
+
+        func addCommit(_ remoteUrl: URL, _ file: String) {
+            let remote = Repository(remoteUrl.path)
+            remote.open()
+            let commit = ImportCommit("refs/heads/main", "Add \(file)", "Test", "test@example.com", Date())
+            commit.writeFile(file, file.data(using: .utf8)!, false)
+            XCTAssertNotNil(remote.importCommits([commit], nil))
+        }
+
+        func makeLocalRepository(_ remoteCount: Int) throws -> Repository {
+            let url = root.appendingPathComponent("local")
+            let repo = Repository(url.path)
+            repo.create()
+
+            for i in 1...remoteCount {
+                let remoteUrl = try makeBareRemote("r\(i)", "file\(i).txt")
+                XCTAssertNotNil(repo.addRemote("r\(i)", remoteUrl.path))
+            }
+
+            return repo
+        }
+
+        func testFetchAllUpdatesTipsAfterEveryDownload() throws {
+            let repo = try makeLocalRepository(3)
+            let local = root.appendingPathComponent("local")
+
+            // A stale remote-tracking branch of r1, pruned as part of the update phase
+            let r1 = root.appendingPathComponent("r1.git")
+            try git("-C", local.path, "config", "remote.r1.prune", "true")
+            try git("-C", r1.path, "branch", "old", "main")
+            repo.fetchAll([repo.getRemotes().first { $0.name == "r1" }!], 1, ProgressRecorder(), nil)
+            try git("-C", r1.path, "branch", "-D", "old")
+            addCommit(r1, "more.txt")
+            XCTAssertTrue(FileManager.default.fileExists(atPath: local.appendingPathComponent(".git/refs/remotes/r1/old").path))
+
+            let progress = ProgressRecorder()
+            let errors = ErrorRecorder()
+            repo.fetchAll(nil, 2, progress, errors)
+
+            XCTAssertEqual(errors.messages, [])
+            XCTAssertEqual(progress.completions, 1)
+            for i in 1...3 {
+                XCTAssertTrue(progress.updatedTips.contains("refs/remotes/r\(i)/main"))
+            }
+            XCTAssertTrue(progress.updatedTips.contains("refs/remotes/r1/old"))
+            XCTAssertFalse(FileManager.default.fileExists(atPath: local.appendingPathComponent(".git/refs/remotes/r1/old").path))
+
+            // References are only updated once every remote finished downloading
+            let lastTransfer = try XCTUnwrap(progress.events.lastIndex(of: "transfer"))
+            let firstTips = try XCTUnwrap(progress.events.firstIndex(of: "tips"))
+            XCTAssertLessThan(lastTransfer, firstTips)
+        }
+
+        func testFetchAllWithNoRemoteFetchesNothing() throws {
+            let repo = try makeLocalRepository(2)
+
+            let progress = ProgressRecorder()
+            let errors = ErrorRecorder()
+            repo.fetchAll([], 0, progress, errors)
+
+            XCTAssertEqual(errors.messages, [])
+            XCTAssertEqual(progress.completions, 1)
+            XCTAssertEqual(progress.updatedTips, [])
+        }
+    }
+    #endif
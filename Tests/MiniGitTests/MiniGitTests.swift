@@ -1,11 +0,0 @@
-    import XCTest
-    @testable import MiniGit
-
-    final class MiniGitTests: XCTestCase {
-        func testExample() {
-            // This is an example of a functional test case.
-            // Use XCTAssert and related functions to verify your tests produce the correct
-            // results.
-            XCTAssertEqual(MiniGit().text, "Hello, World!")
-        }
-    }